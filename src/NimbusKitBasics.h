@@ -131,6 +131,306 @@
 
 #endif
 
+#pragma mark Binary Color Palettes
+
+#import <fcntl.h>
+#import <stdlib.h>
+#import <string.h>
+#import <sys/mman.h>
+#import <sys/stat.h>
+#import <unistd.h>
+
+#define NI_PALETTE_MAGIC   0x4C50494E // "NIPL"
+#define NI_PALETTE_VERSION 1
+
+// A palette file is an NIPaletteHeader followed by `count` int32_t displacements, `count`
+// NIPaletteEntry values and then the entries' names. All values are in native byte order.
+typedef struct {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t count;
+  uint32_t reserved;
+} NIPaletteHeader;
+
+typedef struct {
+  uint32_t nameOffset; // Relative to the start of the names.
+  uint32_t nameLength;
+  uint32_t color;      // 0xAARRGGBB
+} NIPaletteEntry;
+
+// One mapped palette file. Superseded mappings stay mapped until NIPaletteClose so that lookups
+// racing with a theme switch never read unmapped memory. The file's identity lets reopening it
+// reuse the mapping.
+typedef struct NIPaletteMapping {
+  const void* bytes;
+  size_t length;
+  dev_t device;
+  ino_t inode;
+  time_t modificationTime;
+  struct NIPaletteMapping* next;
+} NIPaletteMapping;
+
+// A memory-mapped palette. Zero-initialize before the first NIPaletteOpen.
+typedef struct {
+  NIPaletteMapping* mapping; // The mapping that lookups read.
+  NIPaletteMapping* mappings; // Every file this palette has mapped.
+} NIPalette;
+
+// FNV-1a, finished with the MurmurHash3 mixer so that every seed yields an independent hash.
+NI_INLINE uint32_t NIPaletteHash(const char* name, size_t length, uint32_t seed) {
+  uint32_t hash = 2166136261u ^ seed;
+  for (size_t i = 0; i < length; ++i) {
+    hash ^= (uint8_t)name[i];
+    hash *= 16777619u;
+  }
+  hash ^= hash >> 16;
+  hash *= 0x85EBCA6Bu;
+  hash ^= hash >> 13;
+  hash *= 0xC2B2AE35u;
+  hash ^= hash >> 16;
+  return hash;
+}
+
+#if defined(NI_ENABLE_PALETTE_WRITER)
+
+#import <stdio.h>
+
+// Names are hashed into `count` buckets. A bucket's displacement d is either the seed that places
+// its names into free slots (d > 0) or, for single-name buckets, the slot itself (d = -slot - 1).
+NI_INLINE BOOL NIPaletteWriteFile(const char* path, const char* const* names, const uint32_t* colors,
+                                  uint32_t count) {
+  const uint32_t maxSeed = 1 << 20;
+  BOOL success = NO;
+  uint32_t* bucketOfName = (uint32_t *)malloc(sizeof(uint32_t) * (count + 1));
+  uint32_t* bucketStart = (uint32_t *)calloc(count + 2, sizeof(uint32_t));
+  uint32_t* namesByBucket = (uint32_t *)malloc(sizeof(uint32_t) * (count + 1));
+  int32_t* displacements = (int32_t *)calloc(count + 1, sizeof(int32_t));
+  uint32_t* nameOfSlot = (uint32_t *)malloc(sizeof(uint32_t) * (count + 1));
+  uint32_t* candidateSlots = (uint32_t *)malloc(sizeof(uint32_t) * (count + 1));
+  uint8_t* isSlotUsed = (uint8_t *)calloc(count + 1, sizeof(uint8_t));
+  NIPaletteHeader header = { NI_PALETTE_MAGIC, NI_PALETTE_VERSION, count, 0 };
+  uint32_t maxBucketSize = 0;
+  uint32_t freeSlot = 0;
+  uint32_t nameOffset = 0;
+  FILE* file = NULL;
+
+  if (!bucketOfName || !bucketStart || !namesByBucket || !displacements || !nameOfSlot
+      || !candidateSlots || !isSlotUsed) {
+    goto cleanup;
+  }
+
+  // Group the names by bucket with a counting sort.
+  for (uint32_t i = 0; i < count; ++i) {
+    bucketOfName[i] = NIPaletteHash(names[i], strlen(names[i]), 0) % count;
+    uint32_t bucketSize = ++bucketStart[bucketOfName[i] + 2];
+    maxBucketSize = bucketSize > maxBucketSize ? bucketSize : maxBucketSize;
+  }
+  for (uint32_t bucket = 0; bucket < count; ++bucket) {
+    bucketStart[bucket + 2] += bucketStart[bucket + 1];
+  }
+  for (uint32_t i = 0; i < count; ++i) {
+    namesByBucket[bucketStart[bucketOfName[i] + 1]++] = i;
+  }
+
+  // Place the largest buckets first while the table is still mostly empty.
+  for (uint32_t bucketSize = maxBucketSize; bucketSize > 1; --bucketSize) {
+    for (uint32_t bucket = 0; bucket < count; ++bucket) {
+      const uint32_t* bucketNames = namesByBucket + bucketStart[bucket];
+      if (bucketStart[bucket + 1] - bucketStart[bucket] != bucketSize) {
+        continue;
+      }
+      for (uint32_t i = 0; i < bucketSize; ++i) {
+        for (uint32_t j = i + 1; j < bucketSize; ++j) {
+          if (0 == strcmp(names[bucketNames[i]], names[bucketNames[j]])) {
+            goto cleanup; // Duplicate names can never be separated.
+          }
+        }
+      }
+
+      uint32_t seed = 1;
+      for (; seed < maxSeed; ++seed) {
+        uint32_t placed = 0;
+        for (; placed < bucketSize; ++placed) {
+          const char* name = names[bucketNames[placed]];
+          uint32_t slot = NIPaletteHash(name, strlen(name), seed) % count;
+          if (isSlotUsed[slot]) {
+            break;
+          }
+          isSlotUsed[slot] = 1;
+          candidateSlots[placed] = slot;
+        }
+        if (placed == bucketSize) {
+          break;
+        }
+        for (uint32_t i = 0; i < placed; ++i) {
+          isSlotUsed[candidateSlots[i]] = 0;
+        }
+      }
+      if (seed == maxSeed) {
+        goto cleanup;
+      }
+      displacements[bucket] = (int32_t)seed;
+      for (uint32_t i = 0; i < bucketSize; ++i) {
+        nameOfSlot[candidateSlots[i]] = bucketNames[i];
+      }
+    }
+  }
+
+  // Single-name buckets fill whatever slots remain.
+  for (uint32_t bucket = 0; bucket < count; ++bucket) {
+    if (bucketStart[bucket + 1] - bucketStart[bucket] != 1) {
+      continue;
+    }
+    while (isSlotUsed[freeSlot]) {
+      ++freeSlot;
+    }
+    isSlotUsed[freeSlot] = 1;
+    nameOfSlot[freeSlot] = namesByBucket[bucketStart[bucket]];
+    displacements[bucket] = -(int32_t)freeSlot - 1;
+  }
+
+  file = fopen(path, "wb");
+  if (!file) {
+    goto cleanup;
+  }
+  if (fwrite(&header, sizeof(header), 1, file) != 1
+      || fwrite(displacements, sizeof(int32_t), count, file) != count) {
+    goto cleanup;
+  }
+  for (uint32_t slot = 0; slot < count; ++slot) {
+    uint32_t nameLength = (uint32_t)strlen(names[nameOfSlot[slot]]);
+    NIPaletteEntry entry = { nameOffset, nameLength, colors[nameOfSlot[slot]] };
+    if (fwrite(&entry, sizeof(entry), 1, file) != 1) {
+      goto cleanup;
+    }
+    nameOffset += nameLength + 1;
+  }
+  for (uint32_t slot = 0; slot < count; ++slot) {
+    const char* name = names[nameOfSlot[slot]];
+    if (fwrite(name, 1, strlen(name) + 1, file) != strlen(name) + 1) {
+      goto cleanup;
+    }
+  }
+  success = YES;
+
+cleanup:
+  if (file && fclose(file) != 0) {
+    success = NO;
+  }
+  free(bucketOfName);
+  free(bucketStart);
+  free(namesByBucket);
+  free(displacements);
+  free(nameOfSlot);
+  free(candidateSlots);
+  free(isSlotUsed);
+  return success;
+}
+
+#endif // #if defined(NI_ENABLE_PALETTE_WRITER)
+
+// Unmaps every file the palette has mapped. Lookups must not run concurrently.
+NI_INLINE void NIPaletteClose(NIPalette* palette) {
+  __atomic_store_n(&palette->mapping, NULL, __ATOMIC_RELAXED);
+  NIPaletteMapping* mapping = palette->mappings;
+  palette->mappings = NULL;
+  while (mapping) {
+    NIPaletteMapping* next = mapping->next;
+    munmap((void *)mapping->bytes, mapping->length);
+    free(mapping);
+    mapping = next;
+  }
+}
+
+// Maps the palette at `path` and, only on success, publishes it in place of the palette's current
+// mapping. This is how themes are swapped. Swaps must be serialized, but lookups may run on any
+// thread while a swap happens. Reopening an unchanged file reuses its mapping, so switching back
+// and forth between themes maps each file once.
+NI_INLINE BOOL NIPaletteOpen(NIPalette* palette, const char* path) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    return NO;
+  }
+  struct stat info;
+  if (fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(NIPaletteHeader)) {
+    close(fd);
+    return NO;
+  }
+  size_t length = (size_t)info.st_size;
+  for (NIPaletteMapping* mapping = palette->mappings; mapping; mapping = mapping->next) {
+    if (mapping->device == info.st_dev && mapping->inode == info.st_ino
+        && mapping->length == length && mapping->modificationTime == info.st_mtime) {
+      close(fd);
+      __atomic_store_n(&palette->mapping, mapping, __ATOMIC_RELEASE);
+      return YES;
+    }
+  }
+  void* bytes = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (bytes == MAP_FAILED) {
+    return NO;
+  }
+
+  const NIPaletteHeader* header = (const NIPaletteHeader *)bytes;
+  NIPaletteMapping* mapping = NULL;
+  if (header->magic != NI_PALETTE_MAGIC || header->version != NI_PALETTE_VERSION
+      || (length - sizeof(NIPaletteHeader)) / (sizeof(int32_t) + sizeof(NIPaletteEntry)) < header->count
+      || !(mapping = (NIPaletteMapping *)malloc(sizeof(NIPaletteMapping)))) {
+    munmap(bytes, length);
+    return NO;
+  }
+
+  mapping->bytes = bytes;
+  mapping->length = length;
+  mapping->device = info.st_dev;
+  mapping->inode = info.st_ino;
+  mapping->modificationTime = info.st_mtime;
+  mapping->next = palette->mappings;
+  palette->mappings = mapping;
+  __atomic_store_n(&palette->mapping, mapping, __ATOMIC_RELEASE);
+  return YES;
+}
+
+// Never allocates. Returns NO if the name isn't in the palette.
+NI_INLINE BOOL NIPaletteLookup(const NIPalette* palette, const char* name, uint32_t* color) {
+  const NIPaletteMapping* mapping = __atomic_load_n(&palette->mapping, __ATOMIC_ACQUIRE);
+  if (!mapping) {
+    return NO;
+  }
+  const NIPaletteHeader* header = (const NIPaletteHeader *)mapping->bytes;
+  const uint32_t count = header->count;
+  if (count == 0) {
+    return NO;
+  }
+  const int32_t* displacements = (const int32_t *)(header + 1);
+  const NIPaletteEntry* entries = (const NIPaletteEntry *)(displacements + count);
+  const char* names = (const char *)(entries + count);
+  const size_t namesLength = mapping->length - (size_t)(names - (const char *)mapping->bytes);
+
+  size_t length = strlen(name);
+  int32_t displacement = displacements[NIPaletteHash(name, length, 0) % count];
+  uint32_t slot;
+  if (displacement < 0) {
+    slot = (uint32_t)(-(displacement + 1));
+  } else if (displacement > 0) {
+    slot = NIPaletteHash(name, length, (uint32_t)displacement) % count;
+  } else {
+    return NO;
+  }
+  if (slot >= count) {
+    return NO;
+  }
+
+  const NIPaletteEntry* entry = entries + slot;
+  if (entry->nameLength != length || entry->nameOffset > namesLength
+      || namesLength - entry->nameOffset < length
+      || 0 != memcmp(names + entry->nameOffset, name, length)) {
+    return NO;
+  }
+  *color = entry->color;
+  return YES;
+}
+
 #pragma mark Autoresizing Masks
 
 #ifndef UIViewAutoresizingFlexibleMargins
@@ -216,7 +516,240 @@ NI_INLINE BOOL NIIsRunningTests(void) {
 
 #endif // #if defined(DEBUG) && !defined(NI_DISABLE_DASSERT)
 
-#if defined(DEBUG)
+#if defined(DEBUG) && defined(NI_ENABLE_DPRINT_COALESCING)
+
+#import <pthread.h>
+#import <stdlib.h>
+
+// Repeats of a log line within this many seconds of its first appearance are coalesced.
+#ifndef NI_DPRINT_COALESCING_WINDOW
+#define NI_DPRINT_COALESCING_WINDOW 1.0
+#endif
+
+// The number of distinct log lines each thread tracks. Must be a power of two.
+#ifndef NI_DPRINT_COALESCING_TABLE_SIZE
+#define NI_DPRINT_COALESCING_TABLE_SIZE 64
+#endif
+
+enum {
+  NIDPrintCoalescingEntryEmpty,
+  NIDPrintCoalescingEntryActive,
+  NIDPrintCoalescingEntryBusy, // Claimed by a thread that is reading or writing the entry.
+};
+
+typedef struct {
+  int state;
+  const char* function;
+  int line;
+  NSUInteger hash;
+  CFTypeRef message;
+  NSUInteger repeatCount;
+  CFAbsoluteTime windowStart;
+} NIDPrintCoalescingEntry;
+
+// Each thread logs through its own table, but a table's entries are also flushed by a timer, by
+// the thread's exit and at process exit, so every entry is claimed before it is touched. Tables
+// are recycled rather than freed so that neither the list of tables nor a pending flush can see
+// freed memory.
+typedef struct NIDPrintCoalescingTable {
+  struct NIDPrintCoalescingTable* next;
+  int isInUse;
+  int isFlushScheduled;
+  NIDPrintCoalescingEntry entries[NI_DPRINT_COALESCING_TABLE_SIZE];
+} NIDPrintCoalescingTable;
+
+typedef struct {
+  NIDPrintCoalescingTable* tables;
+  pthread_key_t key;
+  BOOL isKeyValid;
+  dispatch_once_t onceToken;
+} NIDPrintCoalescingState;
+
+// The definition is weak so that every file that imports this header can define it while the
+// linker keeps one copy. All files therefore share one pthread key and one list of tables, and
+// must agree on NI_DPRINT_COALESCING_TABLE_SIZE.
+NI_EXTERN NIDPrintCoalescingState NIDPrintCoalescingSharedState;
+__attribute__((weak)) NIDPrintCoalescingState NIDPrintCoalescingSharedState;
+
+// Returns the entry's state before it was claimed, or NIDPrintCoalescingEntryBusy if another
+// thread holds it, in which case the entry was not claimed.
+NI_INLINE int NIDPrintCoalescingClaimEntry(NIDPrintCoalescingEntry* entry) {
+  int state = __atomic_load_n(&entry->state, __ATOMIC_RELAXED);
+  while (state != NIDPrintCoalescingEntryBusy
+         && !__atomic_compare_exchange_n(&entry->state, &state, NIDPrintCoalescingEntryBusy, YES,
+                                         __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+  }
+  return state;
+}
+
+NI_INLINE void NIDPrintCoalescingUnclaimEntry(NIDPrintCoalescingEntry* entry, int state) {
+  __atomic_store_n(&entry->state, state, __ATOMIC_RELEASE);
+}
+
+// The entry must be claimed and active.
+NI_INLINE void NIDPrintCoalescingFlushEntry(NIDPrintCoalescingEntry* entry) {
+  if (entry->repeatCount > 0) {
+    NSLog(@"%s(%d): %@ (repeated %lu more times)", entry->function, entry->line,
+          (__bridge NSString *)entry->message, (unsigned long)entry->repeatCount);
+  }
+  CFRelease(entry->message);
+  entry->message = NULL;
+}
+
+// Flushes the entries whose windows started at or before `expiryTime`. Returns when the earliest
+// remaining repeated entry expires, or DBL_MAX if none is left. Entries held by other threads are
+// skipped unless `shouldWait` is YES, and count as expiring right away so that they are retried.
+NI_INLINE CFAbsoluteTime NIDPrintCoalescingFlushTable(NIDPrintCoalescingTable* table,
+                                                      CFAbsoluteTime expiryTime, BOOL shouldWait) {
+  CFAbsoluteTime nextExpiryTime = DBL_MAX;
+  for (NSUInteger i = 0; i < NI_DPRINT_COALESCING_TABLE_SIZE; ++i) {
+    NIDPrintCoalescingEntry* entry = &table->entries[i];
+    int state = NIDPrintCoalescingClaimEntry(entry);
+    while (state == NIDPrintCoalescingEntryBusy && shouldWait) {
+      state = NIDPrintCoalescingClaimEntry(entry);
+    }
+    if (state == NIDPrintCoalescingEntryBusy) {
+      nextExpiryTime = expiryTime + NI_DPRINT_COALESCING_WINDOW;
+      continue;
+    }
+    if (state == NIDPrintCoalescingEntryActive && entry->windowStart <= expiryTime) {
+      NIDPrintCoalescingFlushEntry(entry);
+      state = NIDPrintCoalescingEntryEmpty;
+    } else if (state == NIDPrintCoalescingEntryActive && entry->repeatCount > 0
+               && entry->windowStart + NI_DPRINT_COALESCING_WINDOW < nextExpiryTime) {
+      nextExpiryTime = entry->windowStart + NI_DPRINT_COALESCING_WINDOW;
+    }
+    NIDPrintCoalescingUnclaimEntry(entry, state);
+  }
+  return nextExpiryTime;
+}
+
+NI_INLINE void NIDPrintCoalescingFlushExpiredEntries(void* table);
+
+// Arms a single pending flush per table. A flush that is already pending for a later time leaves
+// the new entry's summary up to one window late.
+NI_INLINE void NIDPrintCoalescingScheduleFlush(NIDPrintCoalescingTable* table, CFAbsoluteTime flushTime) {
+  int isFlushScheduled = 0;
+  if (!__atomic_compare_exchange_n(&table->isFlushScheduled, &isFlushScheduled, 1, NO,
+                                   __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+    return;
+  }
+  CFTimeInterval delay = flushTime - CFAbsoluteTimeGetCurrent();
+  if (delay < NI_DPRINT_COALESCING_WINDOW / 10) {
+    delay = NI_DPRINT_COALESCING_WINDOW / 10;
+  }
+  dispatch_after_f(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(delay * NSEC_PER_SEC)),
+                   dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_LOW, 0), table,
+                   NIDPrintCoalescingFlushExpiredEntries);
+}
+
+NI_INLINE void NIDPrintCoalescingFlushExpiredEntries(void* table) {
+  // Cleared first so that a repeat logged during the flush can arm the next one.
+  __atomic_store_n(&((NIDPrintCoalescingTable *)table)->isFlushScheduled, 0, __ATOMIC_RELEASE);
+  CFAbsoluteTime nextExpiryTime =
+      NIDPrintCoalescingFlushTable((NIDPrintCoalescingTable *)table,
+                                   CFAbsoluteTimeGetCurrent() - NI_DPRINT_COALESCING_WINDOW, NO);
+  if (nextExpiryTime < DBL_MAX) {
+    NIDPrintCoalescingScheduleFlush((NIDPrintCoalescingTable *)table, nextExpiryTime);
+  }
+}
+
+// Skips entries that running threads are logging through at exit.
+NI_INLINE void NIDPrintCoalescingFlushAllTables(void) {
+  NIDPrintCoalescingTable* table = __atomic_load_n(&NIDPrintCoalescingSharedState.tables, __ATOMIC_ACQUIRE);
+  for (; table; table = table->next) {
+    NIDPrintCoalescingFlushTable(table, DBL_MAX, NO);
+  }
+}
+
+// Waits out flushes that hold the exiting thread's entries, so every entry is flushed.
+NI_INLINE void NIDPrintCoalescingReleaseTable(void* table) {
+  NIDPrintCoalescingFlushTable((NIDPrintCoalescingTable *)table, DBL_MAX, YES);
+  __atomic_store_n(&((NIDPrintCoalescingTable *)table)->isInUse, 0, __ATOMIC_RELEASE);
+}
+
+// Returns NULL if the table can't be created or registered, in which case lines aren't coalesced.
+NI_INLINE NIDPrintCoalescingTable* NIDPrintCoalescingCurrentTable(void) {
+  NIDPrintCoalescingState* state = &NIDPrintCoalescingSharedState;
+  dispatch_once(&state->onceToken, ^{
+    if (pthread_key_create(&state->key, NIDPrintCoalescingReleaseTable) == 0) {
+      state->isKeyValid = YES;
+      atexit(NIDPrintCoalescingFlushAllTables);
+    }
+  });
+  if (!state->isKeyValid) {
+    return NULL;
+  }
+  NIDPrintCoalescingTable* table = (NIDPrintCoalescingTable *)pthread_getspecific(state->key);
+  if (table) {
+    return table;
+  }
+
+  // Claim a table left behind by an exited thread before allocating a new one.
+  for (table = __atomic_load_n(&state->tables, __ATOMIC_ACQUIRE); table; table = table->next) {
+    int isInUse = 0;
+    if (__atomic_compare_exchange_n(&table->isInUse, &isInUse, 1, NO,
+                                    __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+      break;
+    }
+  }
+  if (!table) {
+    table = (NIDPrintCoalescingTable *)calloc(1, sizeof(NIDPrintCoalescingTable));
+    if (!table) {
+      return NULL;
+    }
+    table->isInUse = 1;
+    table->next = __atomic_load_n(&state->tables, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&state->tables, &table->next, table, YES,
+                                        __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+    }
+  }
+  if (pthread_setspecific(state->key, table) != 0) {
+    __atomic_store_n(&table->isInUse, 0, __ATOMIC_RELEASE);
+    return NULL;
+  }
+  return table;
+}
+
+NI_INLINE void NIDPrintCoalesced(const char* function, int line, NSString* message) {
+  NIDPrintCoalescingTable* table = NIDPrintCoalescingCurrentTable();
+  NSUInteger hash = [message hash] ^ ((uintptr_t)function * 31 + (NSUInteger)line) * 2654435761u;
+  NIDPrintCoalescingEntry* entry = table ? &table->entries[(hash ^ (hash >> 16)) & (NI_DPRINT_COALESCING_TABLE_SIZE - 1)] : NULL;
+  int state = entry ? NIDPrintCoalescingClaimEntry(entry) : NIDPrintCoalescingEntryBusy;
+  if (state == NIDPrintCoalescingEntryBusy) {
+    NSLog(@"%s(%d): %@", function, line, message);
+    return;
+  }
+
+  CFAbsoluteTime now = CFAbsoluteTimeGetCurrent();
+  if (state == NIDPrintCoalescingEntryActive && entry->hash == hash && entry->function == function
+      && entry->line == line && now - entry->windowStart < NI_DPRINT_COALESCING_WINDOW
+      && [(__bridge NSString *)entry->message isEqualToString:message]) {
+    BOOL isFirstRepeat = ++entry->repeatCount == 1;
+    CFAbsoluteTime expiryTime = entry->windowStart + NI_DPRINT_COALESCING_WINDOW;
+    NIDPrintCoalescingUnclaimEntry(entry, NIDPrintCoalescingEntryActive);
+    if (isFirstRepeat) {
+      NIDPrintCoalescingScheduleFlush(table, expiryTime);
+    }
+    return;
+  }
+
+  if (state == NIDPrintCoalescingEntryActive) {
+    NIDPrintCoalescingFlushEntry(entry);
+  }
+  NSLog(@"%s(%d): %@", function, line, message);
+  entry->function = function;
+  entry->line = line;
+  entry->hash = hash;
+  entry->message = CFBridgingRetain(message);
+  entry->repeatCount = 0;
+  entry->windowStart = now;
+  NIDPrintCoalescingUnclaimEntry(entry, NIDPrintCoalescingEntryActive);
+}
+
+#define NI_DPRINT(xx, ...) NIDPrintCoalesced(__PRETTY_FUNCTION__, __LINE__, [NSString stringWithFormat:xx, ##__VA_ARGS__])
+
+#elif defined(DEBUG)
 #define NI_DPRINT(xx, ...) NSLog(@"%s(%d): " xx, __PRETTY_FUNCTION__, __LINE__, ##__VA_ARGS__)
 #else
 #define NI_DPRINT(xx, ...) ((void)0)
@@ -261,6 +794,154 @@ NI_INLINE BOOL NIDeviceOSVersionIsAtLeast(double versionNumber) {
 
 #endif
 
+#pragma mark CPU Feature Checks
+
+#if defined(__x86_64__) || defined(__i386__)
+#import <cpuid.h>
+#if defined(__APPLE__)
+#import <sys/sysctl.h>
+#endif
+#elif defined(__arm__) && defined(__linux__)
+#import <sys/auxv.h>
+#endif
+
+typedef NS_OPTIONS(NSUInteger, NICPUFeatures) {
+  NICPUFeatureSSE42  = 1 << 0,
+  NICPUFeatureAVX2   = 1 << 1,
+  NICPUFeatureAVX512 = 1 << 2, // AVX-512 Foundation
+  NICPUFeatureNEON   = 1 << 3,
+};
+
+// Queries the hardware on every call. Prefer NICPUCurrentFeatures.
+NI_INLINE NICPUFeatures NICPUDetectFeatures(void) {
+  NICPUFeatures features = 0;
+#if defined(__x86_64__) || defined(__i386__)
+  unsigned int eax, ebx, ecx, edx;
+  if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+    return features;
+  }
+  if (ecx & bit_SSE4_2) {
+    features |= NICPUFeatureSSE42;
+  }
+
+  // The AVX register state must be enabled by the OS, not just supported by the CPU.
+  unsigned int xcr0 = 0;
+  if (ecx & bit_OSXSAVE) {
+    __asm__ volatile ("xgetbv" : "=a"(xcr0), "=d"(edx) : "c"(0));
+  }
+  if ((xcr0 & 0x6) != 0x6 || !__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) {
+    return features;
+  }
+  if (ebx & bit_AVX2) {
+    features |= NICPUFeatureAVX2;
+  }
+  if (ebx & bit_AVX512F) {
+#if defined(__APPLE__)
+    // macOS enables the AVX-512 state lazily on first use, so XCR0 can't be trusted.
+    int hasAVX512 = 0;
+    size_t size = sizeof(hasAVX512);
+    if (sysctlbyname("hw.optional.avx512f", &hasAVX512, &size, NULL, 0) == 0 && hasAVX512) {
+      features |= NICPUFeatureAVX512;
+    }
+#else
+    if ((xcr0 & 0xE0) == 0xE0) {
+      features |= NICPUFeatureAVX512;
+    }
+#endif
+  }
+#elif defined(__aarch64__) || defined(__arm64__) || defined(__ARM_NEON__) || defined(__ARM_NEON)
+  // NEON is mandatory on arm64 and was required at compile time otherwise.
+  features |= NICPUFeatureNEON;
+#elif defined(__arm__) && defined(__linux__)
+  if (getauxval(AT_HWCAP) & (1 << 12)) { // HWCAP_NEON
+    features |= NICPUFeatureNEON;
+  }
+#endif
+  return features;
+}
+
+// The weak definition lets every file that imports this header define the cache while the linker
+// keeps one copy, so the hardware is queried once per process.
+NI_EXTERN NSUInteger NICPUCachedFeatures;
+__attribute__((weak)) NSUInteger NICPUCachedFeatures;
+
+// Detection is idempotent, so threads racing on the first call simply detect twice.
+NI_INLINE NICPUFeatures NICPUCurrentFeatures(void) {
+  static const NSUInteger detectedFlag = (NSUInteger)1 << (sizeof(NSUInteger) * 8 - 1);
+  NSUInteger features = __atomic_load_n(&NICPUCachedFeatures, __ATOMIC_RELAXED);
+  if (!features) {
+    features = NICPUDetectFeatures() | detectedFlag;
+    __atomic_store_n(&NICPUCachedFeatures, features, __ATOMIC_RELAXED);
+  }
+  return (NICPUFeatures)(features & ~detectedFlag);
+}
+
+NI_INLINE BOOL NIHasSSE42(void) {
+  return (NICPUCurrentFeatures() & NICPUFeatureSSE42) != 0;
+}
+
+NI_INLINE BOOL NIHasAVX2(void) {
+  return (NICPUCurrentFeatures() & NICPUFeatureAVX2) != 0;
+}
+
+NI_INLINE BOOL NIHasAVX512(void) {
+  return (NICPUCurrentFeatures() & NICPUFeatureAVX512) != 0;
+}
+
+NI_INLINE BOOL NIHasNEON(void) {
+  return (NICPUCurrentFeatures() & NICPUFeatureNEON) != 0;
+}
+
+// Compiles a single function for a more capable instruction set than the rest of the target.
+#ifndef NI_TARGET
+# define NI_TARGET(features) __attribute__((target(features)))
+
+// Example:
+// NI_TARGET("avx2") static float SumAVX2(const float* values, size_t count) { ... }
+
+#endif
+
+// Defines `name` as a function that binds `resolver`'s kernel on its first call and thereafter
+// calls the kernel through a cached pointer.
+#ifndef NI_CPU_DISPATCH
+# define NI_CPU_DISPATCH(returnType, name, parameters, arguments, resolver) \
+  static returnType name##_NIResolve parameters; \
+  static returnType (*name##_NIImplementation) parameters = name##_NIResolve; \
+  static returnType name##_NIResolve parameters { \
+    returnType (*implementation) parameters = (resolver); \
+    __atomic_store_n(&name##_NIImplementation, implementation, __ATOMIC_RELAXED); \
+    return implementation arguments; \
+  } \
+  NI_INLINE returnType name parameters { \
+    return __atomic_load_n(&name##_NIImplementation, __ATOMIC_RELAXED) arguments; \
+  }
+
+// Example:
+// NI_CPU_DISPATCH(float, Sum, (const float* values, size_t count), (values, count),
+//                 NIHasAVX2() ? SumAVX2 : SumScalar)
+
+#endif
+
+// NI_CPU_DISPATCH for kernels that return void.
+#ifndef NI_CPU_DISPATCH_VOID
+# define NI_CPU_DISPATCH_VOID(name, parameters, arguments, resolver) \
+  static void name##_NIResolve parameters; \
+  static void (*name##_NIImplementation) parameters = name##_NIResolve; \
+  static void name##_NIResolve parameters { \
+    void (*implementation) parameters = (resolver); \
+    __atomic_store_n(&name##_NIImplementation, implementation, __ATOMIC_RELAXED); \
+    implementation arguments; \
+  } \
+  NI_INLINE void name parameters { \
+    __atomic_load_n(&name##_NIImplementation, __ATOMIC_RELAXED) arguments; \
+  }
+
+// Example:
+// NI_CPU_DISPATCH_VOID(Scale, (float* values, size_t count, float factor), (values, count, factor),
+//                      NIHasAVX2() ? ScaleAVX2 : ScaleScalar)
+
+#endif
+
 #pragma mark iOS Version Numbers
 
 #define NI_IOS_2_0     20000
@@ -511,6 +1192,415 @@ NI_INLINE BOOL NIDeviceOSVersionIsAtLeast(double versionNumber) {
 
 #endif // #ifndef NI_DISABLE_GENERIC_MATH
 
+#pragma mark Timing Curves
+
+// The number of intervals in each curve's lookup table. Must be at least 1.
+#ifndef NI_TIMING_CURVE_SAMPLE_COUNT
+#define NI_TIMING_CURVE_SAMPLE_COUNT 256
+#endif
+
+// A cubic Bezier timing curve from (0, 0) to (1, 1) with a precomputed lookup table.
+typedef struct {
+  CGFloat ax, bx, cx;
+  CGFloat ay, by, cy;
+  CGFloat samples[NI_TIMING_CURVE_SAMPLE_COUNT + 1];
+} NITimingCurve;
+
+NI_INLINE CGFloat NITimingCurveSampleX(const NITimingCurve* curve, CGFloat t) {
+  return ((curve->ax * t + curve->bx) * t + curve->cx) * t;
+}
+
+NI_INLINE CGFloat NITimingCurveSampleY(const NITimingCurve* curve, CGFloat t) {
+  return ((curve->ay * t + curve->by) * t + curve->cy) * t;
+}
+
+NI_INLINE CGFloat NITimingCurveSampleDerivativeX(const NITimingCurve* curve, CGFloat t) {
+  return ((CGFloat)3 * curve->ax * t + (CGFloat)2 * curve->bx) * t + curve->cx;
+}
+
+// Solves the curve for progress x without using the lookup table. Newton's method converges in a
+// few iterations for most curves; bisection catches the flat spots where it can't.
+NI_INLINE CGFloat NITimingCurveSolve(const NITimingCurve* curve, CGFloat x) {
+  const CGFloat epsilon = NI_CGFLOAT_EPSILON * 4;
+  x = fmin(fmax(x, (CGFloat)0), (CGFloat)1);
+
+  CGFloat t = x;
+  for (int i = 0; i < 8; ++i) {
+    CGFloat error = NITimingCurveSampleX(curve, t) - x;
+    if (fabs(error) < epsilon) {
+      return NITimingCurveSampleY(curve, t);
+    }
+    CGFloat derivative = NITimingCurveSampleDerivativeX(curve, t);
+    if (fabs(derivative) < epsilon) {
+      break;
+    }
+    t -= error / derivative;
+    if (t < 0 || t > 1) {
+      break;
+    }
+  }
+
+  CGFloat lower = 0;
+  CGFloat upper = 1;
+  t = x;
+  for (int i = 0; i < 64 && lower < upper; ++i) {
+    CGFloat error = NITimingCurveSampleX(curve, t) - x;
+    if (fabs(error) < epsilon) {
+      break;
+    }
+    if (error > 0) {
+      upper = t;
+    } else {
+      lower = t;
+    }
+    t = lower + (upper - lower) / 2;
+  }
+  return NITimingCurveSampleY(curve, t);
+}
+
+// Control point x values are clamped to [0, 1] so that the curve is a function of time.
+NI_INLINE void NITimingCurveInit(NITimingCurve* curve, CGFloat x1, CGFloat y1, CGFloat x2, CGFloat y2) {
+  x1 = fmin(fmax(x1, (CGFloat)0), (CGFloat)1);
+  x2 = fmin(fmax(x2, (CGFloat)0), (CGFloat)1);
+
+  curve->cx = (CGFloat)3 * x1;
+  curve->bx = (CGFloat)3 * (x2 - x1) - curve->cx;
+  curve->ax = (CGFloat)1 - curve->cx - curve->bx;
+  curve->cy = (CGFloat)3 * y1;
+  curve->by = (CGFloat)3 * (y2 - y1) - curve->cy;
+  curve->ay = (CGFloat)1 - curve->cy - curve->by;
+
+  for (NSUInteger i = 0; i <= NI_TIMING_CURVE_SAMPLE_COUNT; ++i) {
+    curve->samples[i] = NITimingCurveSolve(curve, (CGFloat)i / NI_TIMING_CURVE_SAMPLE_COUNT);
+  }
+}
+
+#if CGFLOAT_IS_DOUBLE
+typedef int64_t NICGFloatBits;
+#else
+typedef int32_t NICGFloatBits;
+#endif
+
+// Clamps x to [0, 1] by comparing its bits as an integer. Non-negative floats order the same way
+// as their bits, and negative floats have negative bits. Compilers that won't vectorize a
+// floating point comparison under strict IEEE semantics will vectorize this. NaN clamps to 0 or 1
+// depending on its sign.
+NI_INLINE CGFloat NITimingCurveClampProgress(CGFloat x) {
+  const CGFloat one = 1;
+  NICGFloatBits bits;
+  NICGFloatBits oneBits;
+  memcpy(&bits, &x, sizeof(bits));
+  memcpy(&oneBits, &one, sizeof(oneBits));
+  bits = bits > 0 ? bits : 0;
+  bits = bits < oneBits ? bits : oneBits;
+  memcpy(&x, &bits, sizeof(x));
+  return x;
+}
+
+// `offset` locates the curve's samples within `samples`. Keeping it a 32-bit int lets 32-bit
+// CGFloats be gathered too.
+NI_INLINE CGFloat NITimingCurveInterpolateSamples(const CGFloat* samples, int offset, CGFloat x) {
+  CGFloat position = NITimingCurveClampProgress(x) * NI_TIMING_CURVE_SAMPLE_COUNT;
+  int index = (int)position;
+  index = offset + (index < NI_TIMING_CURVE_SAMPLE_COUNT ? index : NI_TIMING_CURVE_SAMPLE_COUNT - 1);
+  CGFloat fraction = position - (CGFloat)(index - offset);
+  CGFloat lower = samples[index];
+  return lower + (samples[index + 1] - lower) * fraction;
+}
+
+NI_INLINE CGFloat NITimingCurveEvaluate(const NITimingCurve* curve, CGFloat x) {
+  return NITimingCurveInterpolateSamples(curve->samples, 0, x);
+}
+
+// Curves are addressed by index so that every lookup is an offset from one base pointer, which
+// lets the loop be vectorized with gather loads (e.g. on AVX2). NITimingCurve holds nothing but
+// CGFloats, so the curves can be indexed as one flat array of CGFloats.
+NI_INLINE void NITimingCurveEvaluateBatch(const NITimingCurve* curves, const uint32_t* curveIndexes,
+                                          const CGFloat* times, CGFloat* __restrict values,
+                                          NSUInteger count) {
+  const int stride = (int)(sizeof(NITimingCurve) / sizeof(CGFloat));
+  const CGFloat* samples = (const CGFloat *)curves + offsetof(NITimingCurve, samples) / sizeof(CGFloat);
+  for (NSUInteger i = 0; i < count; ++i) {
+    values[i] = NITimingCurveInterpolateSamples(samples, (int)curveIndexes[i] * stride, times[i]);
+  }
+}
+
+#pragma mark Pixel Snapping
+
+typedef NS_ENUM(NSInteger, NIPixelSnapMode) {
+  NIPixelSnapModeFloor,
+  NIPixelSnapModeCeil,
+  NIPixelSnapModeRound,
+  NIPixelSnapModeOutset, // Grows rects to cover every pixel they touch.
+};
+
+// round() rounds halfway cases away from zero, which no x86 rounding instruction does, so it stays a
+// libm call. Truncating after adding just under one half gives the same result for every value,
+// including infinities and NaNs, and vectorizes wherever trunc does.
+NI_INLINE CGFloat NIPixelSnapRound(CGFloat value) {
+#if CGFLOAT_IS_DOUBLE
+  return trunc(value + copysign(0.49999999999999994, value));
+#else
+  return truncf(value + copysignf(0.49999997f, value));
+#endif
+}
+
+// Each mode gets its own loop so that the compiler can vectorize it. Clang vectorizes floor, ceil
+// and trunc; gcc only does so on x86 with -fno-trapping-math and otherwise runs these loops scalar.
+#define NI_SNAP_VALUES_TO_PIXELS(roundFn) \
+  for (NSUInteger i = 0; i < count; ++i) { \
+    values[i] = roundFn(values[i] * scale) / scale; \
+  }
+
+NI_INLINE void NISnapValuesToPixels(CGFloat* values, NSUInteger count, CGFloat scale,
+                                    NIPixelSnapMode mode) {
+  switch (mode) {
+    case NIPixelSnapModeFloor:
+    case NIPixelSnapModeOutset:
+      NI_SNAP_VALUES_TO_PIXELS(floor);
+      break;
+    case NIPixelSnapModeCeil:
+      NI_SNAP_VALUES_TO_PIXELS(ceil);
+      break;
+    case NIPixelSnapModeRound:
+      NI_SNAP_VALUES_TO_PIXELS(NIPixelSnapRound);
+      break;
+  }
+}
+
+#undef NI_SNAP_VALUES_TO_PIXELS
+
+// Snaps each rect's edges rather than its origin and size so that adjacent rects stay adjacent.
+// Rects must be standardized. Like the loops above, these vectorize across rects wherever the
+// rounding functions vectorize.
+#define NI_SNAP_RECTS_TO_PIXELS(minRoundFn, maxRoundFn) \
+  for (NSUInteger i = 0; i < count; ++i) { \
+    CGFloat minX = minRoundFn(rects[i].origin.x * scale) / scale; \
+    CGFloat minY = minRoundFn(rects[i].origin.y * scale) / scale; \
+    CGFloat maxX = maxRoundFn((rects[i].origin.x + rects[i].size.width) * scale) / scale; \
+    CGFloat maxY = maxRoundFn((rects[i].origin.y + rects[i].size.height) * scale) / scale; \
+    rects[i].origin.x = minX; \
+    rects[i].origin.y = minY; \
+    rects[i].size.width = maxX - minX; \
+    rects[i].size.height = maxY - minY; \
+  }
+
+NI_INLINE void NISnapRectsToPixels(CGRect* rects, NSUInteger count, CGFloat scale,
+                                   NIPixelSnapMode mode) {
+  switch (mode) {
+    case NIPixelSnapModeFloor:
+      NI_SNAP_RECTS_TO_PIXELS(floor, floor);
+      break;
+    case NIPixelSnapModeCeil:
+      NI_SNAP_RECTS_TO_PIXELS(ceil, ceil);
+      break;
+    case NIPixelSnapModeRound:
+      NI_SNAP_RECTS_TO_PIXELS(NIPixelSnapRound, NIPixelSnapRound);
+      break;
+    case NIPixelSnapModeOutset:
+      NI_SNAP_RECTS_TO_PIXELS(floor, ceil);
+      break;
+  }
+}
+
+#undef NI_SNAP_RECTS_TO_PIXELS
+
+// NIPixelSnapModeOutset floors points.
+NI_INLINE void NISnapPointsToPixels(CGPoint* points, NSUInteger count, CGFloat scale,
+                                    NIPixelSnapMode mode) {
+  NISnapValuesToPixels((CGFloat *)points, count * 2, scale, mode);
+}
+
+// NIPixelSnapModeOutset ceils sizes.
+NI_INLINE void NISnapSizesToPixels(CGSize* sizes, NSUInteger count, CGFloat scale,
+                                   NIPixelSnapMode mode) {
+  NISnapValuesToPixels((CGFloat *)sizes, count * 2, scale,
+                       mode == NIPixelSnapModeOutset ? NIPixelSnapModeCeil : mode);
+}
+
+#if TARGET_OS_IPHONE
+
+// Reads the screen's scale once for the whole batch.
+NI_INLINE void NISnapRectsToScreenPixels(CGRect* rects, NSUInteger count, NIPixelSnapMode mode) {
+  NISnapRectsToPixels(rects, count, NIScreenScale(), mode);
+}
+
+#endif
+
+#pragma mark Dirty Regions
+
+// Combines the comparisons with & rather than && so that there are no branches to keep batches of
+// comparisons from vectorizing.
+NI_INLINE BOOL NIRectEqualToRectWithEpsilon(CGRect rect1, CGRect rect2, CGFloat epsilon) {
+  return (fabs(rect1.origin.x - rect2.origin.x) <= epsilon)
+       & (fabs(rect1.origin.y - rect2.origin.y) <= epsilon)
+       & (fabs(rect1.size.width - rect2.size.width) <= epsilon)
+       & (fabs(rect1.size.height - rect2.size.height) <= epsilon);
+}
+
+// Plain comparisons rather than fmin/fmax, which some compilers call out to libm for.
+NI_INLINE CGRect NIDirtyRectMerge(CGRect rect1, CGRect rect2) {
+  CGFloat maxX1 = rect1.origin.x + rect1.size.width;
+  CGFloat maxY1 = rect1.origin.y + rect1.size.height;
+  CGFloat maxX2 = rect2.origin.x + rect2.size.width;
+  CGFloat maxY2 = rect2.origin.y + rect2.size.height;
+  CGFloat minX = rect1.origin.x < rect2.origin.x ? rect1.origin.x : rect2.origin.x;
+  CGFloat minY = rect1.origin.y < rect2.origin.y ? rect1.origin.y : rect2.origin.y;
+  CGFloat maxX = maxX1 > maxX2 ? maxX1 : maxX2;
+  CGFloat maxY = maxY1 > maxY2 ? maxY1 : maxY2;
+  CGRect rect = { { minX, minY }, { maxX - minX, maxY - minY } };
+  return rect;
+}
+
+// The area that drawing the union of two rects covers beyond drawing both rects separately.
+// Negative when the union is cheaper.
+NI_INLINE CGFloat NIDirtyRectMergeGrowth(CGRect rect1, CGRect rect2) {
+  CGRect merged = NIDirtyRectMerge(rect1, rect2);
+  return merged.size.width * merged.size.height
+         - rect1.size.width * rect1.size.height - rect2.size.width * rect2.size.height;
+}
+
+// The area covered by both rects.
+NI_INLINE CGFloat NIDirtyRectOverlap(CGRect rect1, CGRect rect2) {
+  CGFloat minX = rect1.origin.x > rect2.origin.x ? rect1.origin.x : rect2.origin.x;
+  CGFloat minY = rect1.origin.y > rect2.origin.y ? rect1.origin.y : rect2.origin.y;
+  CGFloat maxX1 = rect1.origin.x + rect1.size.width;
+  CGFloat maxX2 = rect2.origin.x + rect2.size.width;
+  CGFloat maxY1 = rect1.origin.y + rect1.size.height;
+  CGFloat maxY2 = rect2.origin.y + rect2.size.height;
+  CGFloat width = (maxX1 < maxX2 ? maxX1 : maxX2) - minX;
+  CGFloat height = (maxY1 < maxY2 ? maxY1 : maxY2) - minY;
+  return width > 0 && height > 0 ? width * height : 0;
+}
+
+NI_INLINE BOOL NIDirtyRectContainsRect(CGRect outer, CGRect inner) {
+  return (inner.origin.x >= outer.origin.x)
+       & (inner.origin.y >= outer.origin.y)
+       & (inner.origin.x + inner.size.width <= outer.origin.x + outer.size.width)
+       & (inner.origin.y + inner.size.height <= outer.origin.y + outer.size.height);
+}
+
+// Adds `rect` to the dirty rects, merging wherever a merge adds less area than `rectCost`, or
+// wherever it adds the least area once there's no room for another rect.
+NI_INLINE NSUInteger NIDirtyRectsAdd(CGRect* dirtyRects, NSUInteger count, NSUInteger maxCount,
+                                     CGRect rect, CGFloat rectCost) {
+  // A NaN or infinite edge has no pixels to redraw, and merging it would turn the dirty rect's
+  // edges into NaN and lose the damage it already covers.
+  if (rect.size.width <= 0 || rect.size.height <= 0
+      || !isfinite(rect.origin.x + rect.size.width) || !isfinite(rect.origin.y + rect.size.height)) {
+    return count;
+  }
+
+  // Frames near each other in the array tend to be near each other on screen, so the rects
+  // grown most recently are the likeliest to already cover this one.
+  for (NSUInteger i = count; i-- > 0;) {
+    if (NIDirtyRectContainsRect(dirtyRects[i], rect)) {
+      return count;
+    }
+  }
+
+  NSUInteger bestIndex = NSNotFound;
+  CGFloat bestCost = 0;
+  for (NSUInteger i = 0; i < count; ++i) {
+    CGFloat growth = NIDirtyRectMergeGrowth(dirtyRects[i], rect);
+    if (bestIndex == NSNotFound || growth < bestCost) {
+      bestIndex = i;
+      bestCost = growth;
+    }
+  }
+  if (bestIndex == NSNotFound) {
+    dirtyRects[count] = rect;
+    return count + 1;
+  }
+
+  // Area that overlaps another dirty rect is drawn twice, so both choices also pay for the overlap
+  // they add: the rect's own when it stands alone, or the grown rect's new overlap when merged.
+  CGFloat standaloneCost = rectCost;
+  if (count < maxCount) {
+    CGRect merged = NIDirtyRectMerge(dirtyRects[bestIndex], rect);
+    for (NSUInteger j = 0; j < count; ++j) {
+      standaloneCost += NIDirtyRectOverlap(rect, dirtyRects[j]);
+      if (j != bestIndex) {
+        bestCost += NIDirtyRectOverlap(merged, dirtyRects[j])
+                    - NIDirtyRectOverlap(dirtyRects[bestIndex], dirtyRects[j]);
+      }
+    }
+  }
+  if (bestCost >= standaloneCost && count < maxCount) {
+    dirtyRects[count] = rect;
+    return count + 1;
+  }
+
+  // The grown rect may now be worth merging with others. One pass keeps adds linear in the
+  // number of dirty rects.
+  dirtyRects[bestIndex] = NIDirtyRectMerge(dirtyRects[bestIndex], rect);
+  for (NSUInteger i = 0; i < count;) {
+    if (i != bestIndex && NIDirtyRectMergeGrowth(dirtyRects[bestIndex], dirtyRects[i]) < rectCost) {
+      dirtyRects[bestIndex] = NIDirtyRectMerge(dirtyRects[bestIndex], dirtyRects[i]);
+      dirtyRects[i] = dirtyRects[--count];
+      if (bestIndex == count) {
+        bestIndex = i;
+      }
+    } else {
+      ++i;
+    }
+  }
+  return count;
+}
+
+// Replaces the dirty rects with their bounding box when drawing it costs no more than drawing them
+// separately, so that overlapping rects never draw more than the bounding box would.
+NI_INLINE NSUInteger NIDirtyRectsCollapse(CGRect* dirtyRects, NSUInteger count, CGFloat rectCost) {
+  if (count < 2) {
+    return count;
+  }
+  CGRect bounds = dirtyRects[0];
+  CGFloat area = dirtyRects[0].size.width * dirtyRects[0].size.height;
+  for (NSUInteger i = 1; i < count; ++i) {
+    bounds = NIDirtyRectMerge(bounds, dirtyRects[i]);
+    area += dirtyRects[i].size.width * dirtyRects[i].size.height;
+  }
+  if (area + rectCost * (CGFloat)(count - 1) < bounds.size.width * bounds.size.height) {
+    return count;
+  }
+  dirtyRects[0] = bounds;
+  return 1;
+}
+
+#ifndef NI_DIRTY_RECTS_BLOCK_SIZE
+#define NI_DIRTY_RECTS_BLOCK_SIZE 256
+#endif
+
+// Frames are compared a block at a time so that the comparison loop can be vectorized. Collapsing
+// after each block keeps large changes from paying for merges into many overlapping rects.
+NI_INLINE NSUInteger NIDirtyRectsForFrames(const CGRect* previousFrames, const CGRect* currentFrames,
+                                           NSUInteger count, CGFloat epsilon, CGFloat rectCost,
+                                           CGRect* dirtyRects, NSUInteger maxDirtyRects) {
+  NSUInteger dirtyCount = 0;
+  if (maxDirtyRects == 0) {
+    return dirtyCount;
+  }
+
+  uint8_t isChanged[NI_DIRTY_RECTS_BLOCK_SIZE];
+  for (NSUInteger start = 0; start < count; start += NI_DIRTY_RECTS_BLOCK_SIZE) {
+    NSUInteger blockCount = count - start < NI_DIRTY_RECTS_BLOCK_SIZE ? count - start : NI_DIRTY_RECTS_BLOCK_SIZE;
+    const CGRect* previous = previousFrames + start;
+    const CGRect* current = currentFrames + start;
+    for (NSUInteger i = 0; i < blockCount; ++i) {
+      isChanged[i] = !NIRectEqualToRectWithEpsilon(previous[i], current[i], epsilon);
+    }
+
+    for (NSUInteger i = 0; i < blockCount; ++i) {
+      if (isChanged[i]) {
+        dirtyCount = NIDirtyRectsAdd(dirtyRects, dirtyCount, maxDirtyRects, previous[i], rectCost);
+        dirtyCount = NIDirtyRectsAdd(dirtyRects, dirtyCount, maxDirtyRects, current[i], rectCost);
+      }
+    }
+    dirtyCount = NIDirtyRectsCollapse(dirtyRects, dirtyCount, rectCost);
+  }
+  return dirtyCount;
+}
+
 #pragma mark Current Version
 
 #ifndef NIMBUSKIT_BASICS_VERSION
@@ -662,6 +1752,60 @@ NI_INLINE BOOL NIDeviceOSVersionIsAtLeast(double versionNumber) {
  * @ingroup NimbusKitBasics
  */
 
+/** @name Binary Color Palettes */
+
+/**
+ * Writes a palette file mapping each of \p names to the 0xAARRGGBB value at the same index of
+ * \p colors.
+ *
+ * Names are placed with a minimal perfect hash so that a lookup reads exactly one entry. Meant to
+ * be run at build time; the file is in native byte order. Only available when
+ * NI_ENABLE_PALETTE_WRITER is defined before importing this header, so that apps don't pay for
+ * the writer or its includes.
+ *
+ * @returns NO if the file couldn't be written or if \p names contains duplicates.
+ * @fn NIPaletteWriteFile(const char* path, const char* const* names, const uint32_t* colors, uint32_t count)
+ * @ingroup NimbusKitBasics
+ */
+
+/**
+ * Memory-maps the palette file at \p path into \p palette.
+ *
+ * Call this again with another file to switch themes. The new mapping is published atomically
+ * once the file has been mapped and validated, so lookups may run on other threads during a
+ * switch. Calls to this function on the same palette must be serialized.
+ *
+ * Superseded mappings are kept until NIPaletteClose, but reopening a file that hasn't changed
+ * (same device, inode, size and modification time) reuses its mapping. Switching between themes
+ * therefore keeps one mapping per theme file, however often the switch happens. A file that is
+ * replaced is mapped again. Replace palette files by renaming a new file over them rather than
+ * rewriting them in place, which would change the mapped bytes under running lookups.
+ *
+ * @returns NO if the file couldn't be mapped or isn't a palette, leaving \p palette unchanged.
+ * @fn NIPaletteOpen(NIPalette* palette, const char* path)
+ * @ingroup NimbusKitBasics
+ */
+
+/**
+ * Unmaps the palette's file and every file it superseded.
+ *
+ * No lookups may be running on \p palette when this is called.
+ *
+ * @fn NIPaletteClose(NIPalette* palette)
+ * @ingroup NimbusKitBasics
+ */
+
+/**
+ * Looks up the 0xAARRGGBB value for \p name in a mapped palette.
+ *
+ * Performs no allocation or parsing. The value's low 24 bits may be passed directly to
+ * NI_HEXCOLOR or NI_HEXACOLOR.
+ *
+ * @returns NO if \p name isn't in the palette.
+ * @fn NIPaletteLookup(const NIPalette* palette, const char* name, uint32_t* color)
+ * @ingroup NimbusKitBasics
+ */
+
 /** @name Querying the Debugger State */
 
 /**
@@ -698,6 +1842,30 @@ NI_INLINE BOOL NIDeviceOSVersionIsAtLeast(double versionNumber) {
  * @ingroup NimbusKitBasics
  */
 
+/**
+ * Define `NI_ENABLE_DPRINT_COALESCING` in your target's preprocessor macros to collapse repeated
+ * NI_DPRINT and NI_DCONDITIONLOG output.
+ *
+ * A line is keyed by its call site and formatted text. The first occurrence is logged right away.
+ * Repeats within NI_DPRINT_COALESCING_WINDOW seconds are counted instead of logged. The first
+ * repeat arms a timer on a global dispatch queue that writes a single "repeated N more times" line
+ * once the window expires, even if the thread never logs again. The summary may come up to one
+ * more window late when several lines repeat at once. Lines still pending are flushed when their
+ * thread exits and when the process exits.
+ *
+ * Each thread tracks NI_DPRINT_COALESCING_TABLE_SIZE lines in its own table, and every entry is
+ * claimed with a compare-and-swap, so logging takes no locks. A line that collides with another
+ * line's slot flushes that line early, and a line whose slot is being flushed at that moment is
+ * logged without coalescing.
+ *
+ * Every file that enables coalescing shares one pthread key and one list of tables through a weak
+ * global, so NI_DPRINT_COALESCING_TABLE_SIZE must be the same in all of them. If the key can't be
+ * created, lines are logged without coalescing.
+ *
+ * @fn NIDPrintCoalesced(const char* function, int line, NSString* message)
+ * @ingroup NimbusKitBasics
+ */
+
 /**
  * Write the containing method's name to the log using NI_DPRINT.
  *
@@ -774,3 +1942,210 @@ NI_INLINE BOOL NIDeviceOSVersionIsAtLeast(double versionNumber) {
  * @fn NIDeviceOSVersionIsAtLeast(double versionNumber)
  * @ingroup NimbusKitBasics
  */
+
+/** @name Querying the CPU */
+
+/**
+ * Returns the SIMD instruction sets that the CPU supports and the OS has enabled.
+ *
+ * The hardware is queried (cpuid on x86, the auxiliary vector on 32-bit ARM Linux) on the first
+ * call and the result is cached for the whole process.
+ *
+ * @fn NICPUCurrentFeatures()
+ * @ingroup NimbusKitBasics
+ */
+
+/**
+ * Returns YES if the CPU supports SSE 4.2.
+ *
+ * @fn NIHasSSE42()
+ * @ingroup NimbusKitBasics
+ */
+
+/**
+ * Returns YES if the CPU supports AVX2 and the OS saves the AVX register state.
+ *
+ * @fn NIHasAVX2()
+ * @ingroup NimbusKitBasics
+ */
+
+/**
+ * Returns YES if the CPU supports AVX-512 Foundation and the OS saves the AVX-512 register state.
+ *
+ * @fn NIHasAVX512()
+ * @ingroup NimbusKitBasics
+ */
+
+/**
+ * Returns YES if the CPU supports NEON.
+ *
+ * @fn NIHasNEON()
+ * @ingroup NimbusKitBasics
+ */
+
+/**
+ * Compiles the function it's attached to for the given instruction sets, e.g. "avx2".
+ *
+ * Only call such a function after checking for the instruction sets at runtime.
+ *
+ * @fn #NI_TARGET(features)
+ * @ingroup NimbusKitBasics
+ */
+
+/**
+ * Defines a function that picks the best implementation of a kernel on its first call.
+ *
+ * \p resolver is evaluated once, on the first call to \p name, and must produce a pointer to a
+ * function with the signature `returnType (*) parameters`. Every call after that is a single
+ * indirect call through the cached pointer.
+ *
+ * This lets one binary take advantage of newer instruction sets while still running on older
+ * CPUs. \p returnType may not be void; use NI_CPU_DISPATCH_VOID for such kernels.
+ *
+ * @fn #NI_CPU_DISPATCH(returnType, name, parameters, arguments, resolver)
+ * @ingroup NimbusKitBasics
+ */
+
+/**
+ * Same as NI_CPU_DISPATCH, for kernels that return void.
+ *
+ * @fn #NI_CPU_DISPATCH_VOID(name, parameters, arguments, resolver)
+ * @ingroup NimbusKitBasics
+ */
+
+/** @name Timing Curves */
+
+/**
+ * Initializes a cubic Bezier timing curve with control points (x1, y1) and (x2, y2).
+ *
+ * The curve's lookup table is built here by solving the curve at
+ * NI_TIMING_CURVE_SAMPLE_COUNT + 1 evenly spaced points, so initialize each curve once and reuse
+ * it. Define NI_TIMING_CURVE_SAMPLE_COUNT in your target's preprocessor macros to trade memory for
+ * accuracy.
+ *
+ * The control points match those of CAMediaTimingFunction, e.g. (0.42, 0, 0.58, 1) for ease in/out.
+ *
+ * @fn NITimingCurveInit(NITimingCurve* curve, CGFloat x1, CGFloat y1, CGFloat x2, CGFloat y2)
+ * @ingroup NimbusKitBasics
+ */
+
+/**
+ * Returns the curve's value at progress \p x by interpolating its lookup table.
+ *
+ * Constant time and branch-free. \p x is clamped to [0, 1].
+ *
+ * With the default table size the error is below 1e-4 for the standard ease curves and below 1e-3
+ * for most custom curves. Curves with a vertical tangent (e.g. x1 = 0 with y1 = 1) are poorly
+ * approximated near the tangent; use NITimingCurveSolve for those.
+ *
+ * @fn NITimingCurveEvaluate(const NITimingCurve* curve, CGFloat x)
+ * @ingroup NimbusKitBasics
+ */
+
+/**
+ * Evaluates \p count (curve, time) pairs, writing the value of `curves[curveIndexes[i]]` at
+ * `times[i]` to `values[i]`.
+ *
+ * Gives the same results as NITimingCurveEvaluate. The loop has no libm calls or floating point
+ * branches, so compilers vectorize it on targets with gather loads (e.g. GCC and Clang with AVX2).
+ * \p values must not overlap the other arrays.
+ *
+ * @fn NITimingCurveEvaluateBatch(const NITimingCurve* curves, const uint32_t* curveIndexes, const CGFloat* times, CGFloat* values, NSUInteger count)
+ * @ingroup NimbusKitBasics
+ */
+
+/**
+ * Returns the curve's value at progress \p x without using the lookup table.
+ *
+ * The curve is solved until its x is within a few ulps of \p x, which keeps the value within
+ * 64 * NI_CGFLOAT_EPSILON for curves whose slope stays finite. Near a vertical tangent, e.g.
+ * cubic-bezier(0, 1, 1, 0) at its ends, the error grows to at most the square root of
+ * NI_CGFLOAT_EPSILON (measured 7e-5 with float and 2e-10 with double).
+ *
+ * Several times slower than NITimingCurveEvaluate.
+ *
+ * @fn NITimingCurveSolve(const NITimingCurve* curve, CGFloat x)
+ * @ingroup NimbusKitBasics
+ */
+
+/** @name Pixel Snapping */
+
+/**
+ * Snaps the edges of \p count rects to the pixel grid of a display with the given \p scale.
+ *
+ * Each edge is snapped with `floor`, `ceil` or `round` exactly as `round(edge * scale) / scale`
+ * would, so the results match snapping each rect by hand. NIPixelSnapModeOutset floors the min
+ * edges and ceils the max edges so that each rect covers every pixel it touches.
+ *
+ * Fetch the scale once per batch rather than calling NIScreenScale for every rect. Rects are
+ * expected to be standardized.
+ *
+ * Each mode runs its own loop over the whole batch. These loops vectorize across rects with clang,
+ * and with gcc when -fno-trapping-math is set; gcc's default keeps floor and ceil scalar on x86.
+ *
+ * @fn NISnapRectsToPixels(CGRect* rects, NSUInteger count, CGFloat scale, NIPixelSnapMode mode)
+ * @ingroup NimbusKitBasics
+ */
+
+/**
+ * Snaps \p count values to the pixel grid of a display with the given \p scale.
+ *
+ * Each value is snapped exactly as `floor(value * scale) / scale` would be, or with ceil or round
+ * for the other modes. NIPixelSnapModeOutset floors, since a lone value has no max edge. This is
+ * the loop behind NISnapPointsToPixels and NISnapSizesToPixels, and works for any flat array of
+ * coordinates.
+ *
+ * @fn NISnapValuesToPixels(CGFloat* values, NSUInteger count, CGFloat scale, NIPixelSnapMode mode)
+ * @ingroup NimbusKitBasics
+ */
+
+/**
+ * Snaps \p count points to the pixel grid. NIPixelSnapModeOutset floors.
+ *
+ * @fn NISnapPointsToPixels(CGPoint* points, NSUInteger count, CGFloat scale, NIPixelSnapMode mode)
+ * @ingroup NimbusKitBasics
+ */
+
+/**
+ * Snaps \p count sizes to the pixel grid. NIPixelSnapModeOutset ceils.
+ *
+ * @fn NISnapSizesToPixels(CGSize* sizes, NSUInteger count, CGFloat scale, NIPixelSnapMode mode)
+ * @ingroup NimbusKitBasics
+ */
+
+/**
+ * Snaps \p count rects to the main screen's pixel grid, reading the screen's scale once.
+ *
+ * @fn NISnapRectsToScreenPixels(CGRect* rects, NSUInteger count, NIPixelSnapMode mode)
+ * @ingroup NimbusKitBasics
+ */
+
+/** @name Dirty Regions */
+
+/**
+ * Returns YES if every edge of \p rect1 is within \p epsilon of the matching edge of \p rect2.
+ *
+ * @fn NIRectEqualToRectWithEpsilon(CGRect rect1, CGRect rect2, CGFloat epsilon)
+ * @ingroup NimbusKitBasics
+ */
+
+/**
+ * Computes at most \p maxDirtyRects rects that cover every frame that changed between
+ * \p previousFrames and \p currentFrames.
+ *
+ * A frame has changed if any of its values differs by more than \p epsilon. Both its previous
+ * and current frames are then treated as damaged. Damage that a dirty rect already covers is
+ * skipped. Otherwise it is merged whenever merging overdraws less than \p rectCost points of area,
+ * counting area that would overlap other dirty rects, so a higher cost yields fewer, larger rects.
+ * Once \p maxDirtyRects rects exist, further damage is merged wherever it overdraws the least.
+ * Whenever the rects would draw as much as their bounding box, they are replaced by it, so the
+ * result never draws more area than the bounding box of the damage.
+ *
+ * Frames are expected to be standardized. Pass an \p epsilon suited to your coordinates, e.g.
+ * NI_CGFLOAT_EPSILON multiplied by the largest coordinate in the scene. A frame with a NaN or
+ * infinite edge counts as changed, but only its other, finite frame is covered.
+ *
+ * @returns The number of rects written to \p dirtyRects.
+ * @fn NIDirtyRectsForFrames(const CGRect* previousFrames, const CGRect* currentFrames, NSUInteger count, CGFloat epsilon, CGFloat rectCost, CGRect* dirtyRects, NSUInteger maxDirtyRects)
+ * @ingroup NimbusKitBasics
+ */
@@ -0,0 +1,143 @@
+/*
+ Copyright 2014-present Jeff Verkoeyen. All Rights Reserved.
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+// Checks the CPU feature checks against the compiler's own detection, and that NI_CPU_DISPATCH and
+// NI_CPU_DISPATCH_VOID resolve their kernels exactly once.
+
+#include <stdio.h>
+
+#include "NimbusKitBasics.h"
+
+typedef float (*SumFunction)(const float* values, size_t count);
+typedef void (*ScaleFunction)(float* values, size_t count, float factor);
+
+static int gSumResolveCount;
+static int gScaleResolveCount;
+
+static float SumScalar(const float* values, size_t count) {
+  float sum = 0;
+  for (size_t i = 0; i < count; ++i) {
+    sum += values[i];
+  }
+  return sum;
+}
+
+static void ScaleScalar(float* values, size_t count, float factor) {
+  for (size_t i = 0; i < count; ++i) {
+    values[i] *= factor;
+  }
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+
+NI_TARGET("avx2") static float SumAVX2(const float* values, size_t count) {
+  float sum = 0;
+  for (size_t i = 0; i < count; ++i) {
+    sum += values[i];
+  }
+  return sum;
+}
+
+NI_TARGET("avx2") static void ScaleAVX2(float* values, size_t count, float factor) {
+  for (size_t i = 0; i < count; ++i) {
+    values[i] *= factor;
+  }
+}
+
+static SumFunction ResolveSum(void) {
+  ++gSumResolveCount;
+  return NIHasAVX2() ? SumAVX2 : SumScalar;
+}
+
+static ScaleFunction ResolveScale(void) {
+  ++gScaleResolveCount;
+  return NIHasAVX2() ? ScaleAVX2 : ScaleScalar;
+}
+
+#else
+
+static SumFunction ResolveSum(void) {
+  ++gSumResolveCount;
+  return SumScalar;
+}
+
+static ScaleFunction ResolveScale(void) {
+  ++gScaleResolveCount;
+  return ScaleScalar;
+}
+
+#endif
+
+NI_CPU_DISPATCH(float, Sum, (const float* values, size_t count), (values, count), ResolveSum())
+NI_CPU_DISPATCH_VOID(Scale, (float* values, size_t count, float factor), (values, count, factor),
+                     ResolveScale())
+
+static int CheckFeature(const char* name, BOOL actual, int expected) {
+  printf("%-7s %s\n", name, actual ? "yes" : "no");
+  if (actual != (expected != 0)) {
+    printf("FAIL %s: expected %s\n", name, expected ? "yes" : "no");
+    return 1;
+  }
+  return 0;
+}
+
+static int TestFeatures(void) {
+  int failures = 0;
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_cpu_init();
+  failures += CheckFeature("SSE4.2", NIHasSSE42(), __builtin_cpu_supports("sse4.2"));
+  failures += CheckFeature("AVX2", NIHasAVX2(), __builtin_cpu_supports("avx2"));
+  failures += CheckFeature("AVX-512", NIHasAVX512(), __builtin_cpu_supports("avx512f"));
+  failures += CheckFeature("NEON", NIHasNEON(), 0);
+#elif defined(__aarch64__)
+  failures += CheckFeature("NEON", NIHasNEON(), 1);
+  failures += CheckFeature("AVX2", NIHasAVX2(), 0);
+#endif
+  if (__atomic_load_n(&NICPUCachedFeatures, __ATOMIC_RELAXED) == 0) {
+    printf("FAIL the detected features weren't cached\n");
+    ++failures;
+  }
+  return failures;
+}
+
+static int TestDispatch(void) {
+  float values[100];
+  for (int i = 0; i < 100; ++i) {
+    values[i] = 1;
+  }
+  int failures = 0;
+  for (int call = 0; call < 10; ++call) {
+    Scale(values, 100, 2);
+    if (Sum(values, 100) != 100 * (float)(2 << call)) {
+      printf("FAIL wrong result on call %d\n", call);
+      ++failures;
+    }
+  }
+  if (gSumResolveCount != 1 || gScaleResolveCount != 1) {
+    printf("FAIL resolvers ran %d and %d times\n", gSumResolveCount, gScaleResolveCount);
+    ++failures;
+  }
+  return failures;
+}
+
+int main(void) {
+  int failures = 0;
+  failures += TestFeatures();
+  failures += TestDispatch();
+
+  printf("%s\n", failures ? "FAILED" : "PASSED");
+  return failures ? 1 : 0;
+}
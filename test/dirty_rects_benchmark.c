@@ -0,0 +1,104 @@
+/*
+ Copyright 2014-present Jeff Verkoeyen. All Rights Reserved.
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+// Times NIDirtyRectsForFrames on a large grid of elements with varying amounts of change, and
+// checks that every changed frame is covered by one of the dirty rects.
+
+#include <stdio.h>
+#include <time.h>
+
+#include "NimbusKitBasics.h"
+
+enum { kElementCount = 20000, kColumnCount = 100, kRepetitions = 200 };
+
+static double Now(void) {
+  struct timespec time;
+  clock_gettime(CLOCK_MONOTONIC, &time);
+  return (double)time.tv_sec + (double)time.tv_nsec * 1e-9;
+}
+
+static BOOL RectContainsRect(CGRect outer, CGRect inner) {
+  return inner.origin.x >= outer.origin.x && inner.origin.y >= outer.origin.y
+      && inner.origin.x + inner.size.width <= outer.origin.x + outer.size.width
+      && inner.origin.y + inner.size.height <= outer.origin.y + outer.size.height;
+}
+
+// Returns the number of changed frames that no dirty rect covers.
+static int CountUncovered(const CGRect* previousFrames, const CGRect* currentFrames,
+                          const CGRect* dirtyRects, NSUInteger dirtyCount) {
+  int uncovered = 0;
+  for (NSUInteger i = 0; i < kElementCount; ++i) {
+    if (NIRectEqualToRectWithEpsilon(previousFrames[i], currentFrames[i], 0.001)) {
+      continue;
+    }
+    BOOL isPreviousCovered = NO;
+    BOOL isCurrentCovered = NO;
+    for (NSUInteger j = 0; j < dirtyCount; ++j) {
+      isPreviousCovered |= RectContainsRect(dirtyRects[j], previousFrames[i]);
+      isCurrentCovered |= RectContainsRect(dirtyRects[j], currentFrames[i]);
+    }
+    uncovered += !isPreviousCovered + !isCurrentCovered;
+  }
+  return uncovered;
+}
+
+int main(void) {
+  static CGRect previousFrames[kElementCount];
+  static CGRect currentFrames[kElementCount];
+  static const int changedPerThousand[] = { 0, 1, 10, 100, 1000 };
+  static const NSUInteger maxDirtyRectCounts[] = { 8, 32 };
+
+  for (NSUInteger i = 0; i < kElementCount; ++i) {
+    CGRect frame = { { (CGFloat)(i % kColumnCount) * 48, (CGFloat)(i / kColumnCount) * 48 },
+                     { 44, 44 } };
+    previousFrames[i] = frame;
+  }
+
+  printf("%d elements, CGFloat is %s\n", kElementCount, CGFLOAT_IS_DOUBLE ? "double" : "float");
+  int failures = 0;
+  for (size_t c = 0; c < sizeof(changedPerThousand) / sizeof(*changedPerThousand); ++c) {
+    // Changed elements are scattered over the grid and nudged by a few points.
+    for (NSUInteger i = 0; i < kElementCount; ++i) {
+      currentFrames[i] = previousFrames[i];
+      if ((int)((i * 2654435761u) % 1000) < changedPerThousand[c]) {
+        currentFrames[i].origin.x += 3;
+        currentFrames[i].origin.y -= 2;
+      }
+    }
+
+    for (size_t m = 0; m < sizeof(maxDirtyRectCounts) / sizeof(*maxDirtyRectCounts); ++m) {
+      CGRect dirtyRects[32];
+      NSUInteger dirtyCount = 0;
+      double start = Now();
+      for (int repetition = 0; repetition < kRepetitions; ++repetition) {
+        dirtyCount = NIDirtyRectsForFrames(previousFrames, currentFrames, kElementCount, 0.001,
+                                           64 * 64, dirtyRects, maxDirtyRectCounts[m]);
+      }
+      double frameTime = (Now() - start) / ((double)kRepetitions * kElementCount);
+
+      CGFloat dirtyArea = 0;
+      for (NSUInteger i = 0; i < dirtyCount; ++i) {
+        dirtyArea += dirtyRects[i].size.width * dirtyRects[i].size.height;
+      }
+      int uncovered = CountUncovered(previousFrames, currentFrames, dirtyRects, dirtyCount);
+      failures += uncovered;
+      printf("%5.1f%% changed, max %2lu rects: %6.2f ns/element, %2lu rects, area %10.0f%s\n",
+             changedPerThousand[c] / 10.0, (unsigned long)maxDirtyRectCounts[m], frameTime * 1e9,
+             (unsigned long)dirtyCount, (double)dirtyArea, uncovered ? " UNCOVERED FRAMES" : "");
+    }
+  }
+  return failures ? 1 : 0;
+}
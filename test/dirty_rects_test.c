@@ -0,0 +1,175 @@
+/*
+ Copyright 2014-present Jeff Verkoeyen. All Rights Reserved.
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+// Checks that NIDirtyRectsForFrames covers every changed frame.
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "NimbusKitBasics.h"
+
+#define kMaxDirtyRects 32
+
+static BOOL RectContainsRect(CGRect outer, CGRect inner) {
+  return inner.origin.x >= outer.origin.x && inner.origin.y >= outer.origin.y
+      && inner.origin.x + inner.size.width <= outer.origin.x + outer.size.width
+      && inner.origin.y + inner.size.height <= outer.origin.y + outer.size.height;
+}
+
+static BOOL IsFinite(CGRect rect) {
+  return isfinite(rect.origin.x + rect.size.width) && isfinite(rect.origin.y + rect.size.height);
+}
+
+// Returns the number of failures: changed, finite frames that no dirty rect covers, more dirty rects
+// than allowed, and dirty rects that draw more area than the bounding box of the damage.
+static int CheckDirtyRects(const char* name, const CGRect* previousFrames,
+                           const CGRect* currentFrames, NSUInteger count,
+                           NSUInteger maxDirtyRects, CGFloat rectCost) {
+  CGRect dirtyRects[kMaxDirtyRects];
+  NSUInteger dirtyCount = NIDirtyRectsForFrames(previousFrames, currentFrames, count, 0.001,
+                                                rectCost, dirtyRects, maxDirtyRects);
+  int failures = 0;
+  if (dirtyCount > maxDirtyRects) {
+    printf("FAIL %s: %lu dirty rects exceed the maximum of %lu\n", name,
+           (unsigned long)dirtyCount, (unsigned long)maxDirtyRects);
+    ++failures;
+  }
+  CGRect bounds = { { 0, 0 }, { 0, 0 } };
+  BOOL hasDamage = NO;
+  for (NSUInteger i = 0; i < count; ++i) {
+    if (NIRectEqualToRectWithEpsilon(previousFrames[i], currentFrames[i], 0.001)) {
+      continue;
+    }
+    const CGRect frames[] = { previousFrames[i], currentFrames[i] };
+    for (int f = 0; f < 2; ++f) {
+      if (!IsFinite(frames[f]) || frames[f].size.width <= 0 || frames[f].size.height <= 0) {
+        continue;
+      }
+      bounds = hasDamage ? NIDirtyRectMerge(bounds, frames[f]) : frames[f];
+      hasDamage = YES;
+      BOOL isCovered = NO;
+      for (NSUInteger j = 0; j < dirtyCount && !isCovered; ++j) {
+        isCovered = RectContainsRect(dirtyRects[j], frames[f]);
+      }
+      if (!isCovered) {
+        if (failures++ < 5) {
+          printf("FAIL %s: frame %lu {%g, %g, %g, %g} is not covered\n", name, (unsigned long)i,
+                 (double)frames[f].origin.x, (double)frames[f].origin.y,
+                 (double)frames[f].size.width, (double)frames[f].size.height);
+        }
+      }
+    }
+  }
+
+  double dirtyArea = 0;
+  for (NSUInteger i = 0; i < dirtyCount; ++i) {
+    dirtyArea += (double)(dirtyRects[i].size.width * dirtyRects[i].size.height);
+  }
+  double boundsArea = (double)(bounds.size.width * bounds.size.height);
+  if (dirtyArea > boundsArea * (1 + 1e-6)) {
+    printf("FAIL %s: dirty area %g exceeds the damage's bounding box %g\n", name, dirtyArea,
+           boundsArea);
+    ++failures;
+  }
+  return failures;
+}
+
+// A frame that becomes NaN must not erase the damage of other frames.
+static int TestNonFiniteFrames(void) {
+  CGRect previousFrames[] = { { { 0, 0 }, { 10, 10 } }, { { 50, 0 }, { 10, 10 } },
+                              { { 50, 100 }, { 10, 10 } } };
+  CGRect currentFrames[] = { { { 5, 0 }, { 10, 10 } }, { { NAN, 0 }, { 10, 10 } },
+                             { { 55, 100 }, { 10, 10 } } };
+  int failures = 0;
+  for (NSUInteger maxDirtyRects = 1; maxDirtyRects <= 3; ++maxDirtyRects) {
+    failures += CheckDirtyRects("NaN frame", previousFrames, currentFrames, 3, maxDirtyRects, 64);
+  }
+  currentFrames[1].origin.x = INFINITY;
+  failures += CheckDirtyRects("infinite frame", previousFrames, currentFrames, 3, 1, 64);
+  currentFrames[1].origin.x = 50;
+  currentFrames[1].size.width = -INFINITY;
+  failures += CheckDirtyRects("infinite size", previousFrames, currentFrames, 3, 1, 64);
+  return failures;
+}
+
+// Random scenes with random amounts of change, covering every bound on the number of rects.
+static int TestRandomScenes(void) {
+  enum { kFrameCount = 1000 };
+  static CGRect previousFrames[kFrameCount];
+  static CGRect currentFrames[kFrameCount];
+  int failures = 0;
+  srand(1);
+  for (int scene = 0; scene < 200; ++scene) {
+    int changedPercent = rand() % 101;
+    for (NSUInteger i = 0; i < kFrameCount; ++i) {
+      CGRect frame = { { (CGFloat)(rand() % 2000), (CGFloat)(rand() % 4000) },
+                       { (CGFloat)(rand() % 200 + 1), (CGFloat)(rand() % 200 + 1) } };
+      previousFrames[i] = frame;
+      if (rand() % 100 < changedPercent) {
+        frame.origin.x += (CGFloat)(rand() % 41 - 20);
+        frame.size.height += (CGFloat)(rand() % 20);
+      }
+      currentFrames[i] = frame;
+    }
+    char name[32];
+    snprintf(name, sizeof(name), "scene %d", scene);
+    failures += CheckDirtyRects(name, previousFrames, currentFrames, kFrameCount,
+                                (NSUInteger)(scene % kMaxDirtyRects) + 1,
+                                (CGFloat)(rand() % 10000));
+  }
+  return failures;
+}
+
+// A grid of 20,000 elements with scattered changes used to draw more than its bounding box once
+// more dirty rects were allowed.
+static int TestScatteredChanges(void) {
+  enum { kFrameCount = 20000, kColumnCount = 100 };
+  static CGRect previousFrames[kFrameCount];
+  static CGRect currentFrames[kFrameCount];
+  static const int changedPerThousand[] = { 1, 10, 100, 1000 };
+  int failures = 0;
+  for (size_t c = 0; c < sizeof(changedPerThousand) / sizeof(*changedPerThousand); ++c) {
+    for (NSUInteger i = 0; i < kFrameCount; ++i) {
+      CGRect frame = { { (CGFloat)(i % kColumnCount) * 48, (CGFloat)(i / kColumnCount) * 48 },
+                       { 44, 44 } };
+      previousFrames[i] = frame;
+      if ((int)((i * 2654435761u) % 1000) < changedPerThousand[c]) {
+        frame.origin.x += 3;
+        frame.origin.y -= 2;
+      }
+      currentFrames[i] = frame;
+    }
+    for (NSUInteger maxDirtyRects = 8; maxDirtyRects <= kMaxDirtyRects; maxDirtyRects *= 2) {
+      char name[48];
+      snprintf(name, sizeof(name), "grid, %d/1000 changed, %lu rects", changedPerThousand[c],
+               (unsigned long)maxDirtyRects);
+      failures += CheckDirtyRects(name, previousFrames, currentFrames, kFrameCount, maxDirtyRects,
+                                  64 * 64);
+    }
+  }
+  return failures;
+}
+
+int main(void) {
+  printf("CGFloat is %s\n", CGFLOAT_IS_DOUBLE ? "double" : "float");
+  int failures = 0;
+  failures += TestNonFiniteFrames();
+  failures += TestRandomScenes();
+  failures += TestScatteredChanges();
+
+  printf("%s\n", failures ? "FAILED" : "PASSED");
+  return failures ? 1 : 0;
+}
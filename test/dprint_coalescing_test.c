@@ -0,0 +1,317 @@
+/*
+ Copyright 2014-present Jeff Verkoeyen. All Rights Reserved.
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+// Checks NI_DPRINT coalescing: summaries after a burst, timer re-arming, flushing at thread exit,
+// table recycling, flushing at exit while threads log, and the fallback when no pthread key can
+// be created. Runs against a C translation of the header's code; see the Makefile.
+
+#include <errno.h>
+#include <float.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define NI_DPRINT_COALESCING_WINDOW 0.05
+
+typedef unsigned long NSUInteger;
+typedef signed char BOOL;
+#define YES 1
+#define NO 0
+#define NI_INLINE static inline
+#define NI_EXTERN extern
+typedef const void* CFTypeRef;
+typedef double CFAbsoluteTime;
+typedef double CFTimeInterval;
+typedef long dispatch_once_t;
+#define NSEC_PER_SEC 1000000000ll
+#define DISPATCH_TIME_NOW 0
+#define DISPATCH_QUEUE_PRIORITY_LOW 0
+
+static CFAbsoluteTime CFAbsoluteTimeGetCurrent(void) {
+  struct timespec time;
+  clock_gettime(CLOCK_MONOTONIC, &time);
+  return (double)time.tv_sec + (double)time.tv_nsec * 1e-9;
+}
+
+static NSUInteger StringHash(const char* string) {
+  NSUInteger hash = 5381;
+  while (*string) {
+    hash = hash * 33 + (unsigned char)*string++;
+  }
+  return hash;
+}
+
+#pragma mark libdispatch
+
+typedef struct {
+  int64_t delay;
+  void* context;
+  void (*function)(void*);
+} PendingCall;
+
+static int gFlushesScheduled;
+
+static void* RunPendingCall(void* context) {
+  PendingCall call = *(PendingCall *)context;
+  free(context);
+  struct timespec delay = { (time_t)(call.delay / NSEC_PER_SEC), (long)(call.delay % NSEC_PER_SEC) };
+  nanosleep(&delay, NULL);
+  call.function(call.context);
+  return NULL;
+}
+
+static int64_t dispatch_time(int when, int64_t delta) {
+  (void)when;
+  return delta;
+}
+
+static void* dispatch_get_global_queue(long priority, unsigned long flags) {
+  (void)priority;
+  (void)flags;
+  return NULL;
+}
+
+static void dispatch_after_f(int64_t when, void* queue, void* context, void (*function)(void*)) {
+  (void)queue;
+  __atomic_fetch_add(&gFlushesScheduled, 1, __ATOMIC_RELAXED);
+  PendingCall* call = (PendingCall *)malloc(sizeof(PendingCall));
+  call->delay = when;
+  call->context = context;
+  call->function = function;
+  pthread_t thread;
+  pthread_attr_t attributes;
+  pthread_attr_init(&attributes);
+  pthread_attr_setdetachstate(&attributes, PTHREAD_CREATE_DETACHED);
+  pthread_create(&thread, &attributes, RunPendingCall, call);
+  pthread_attr_destroy(&attributes);
+}
+
+#pragma mark Logging
+
+static pthread_mutex_t gLogLock = PTHREAD_MUTEX_INITIALIZER;
+static long gLines;       // Lines logged as is.
+static long gSummaries;   // "repeated N more times" lines.
+static long gRepeats;     // The sum of their N.
+
+static void NSLog(const char* format, ...) {
+  char line[512];
+  va_list arguments;
+  va_start(arguments, format);
+  vsnprintf(line, sizeof(line), format, arguments);
+  va_end(arguments);
+
+  pthread_mutex_lock(&gLogLock);
+  const char* repeated = strstr(line, "(repeated ");
+  if (repeated) {
+    ++gSummaries;
+    gRepeats += atol(repeated + strlen("(repeated "));
+  } else {
+    ++gLines;
+  }
+  pthread_mutex_unlock(&gLogLock);
+}
+
+static void ResetLog(void) {
+  pthread_mutex_lock(&gLogLock);
+  gLines = 0;
+  gSummaries = 0;
+  gRepeats = 0;
+  pthread_mutex_unlock(&gLogLock);
+}
+
+static void ReadLog(long* lines, long* summaries, long* repeats) {
+  pthread_mutex_lock(&gLogLock);
+  *lines = gLines;
+  *summaries = gSummaries;
+  *repeats = gRepeats;
+  pthread_mutex_unlock(&gLogLock);
+}
+
+static int gShouldFailKeyCreation;
+
+static int CreateKey(pthread_key_t* key, void (*destructor)(void*)) {
+  return gShouldFailKeyCreation ? EAGAIN : pthread_key_create(key, destructor);
+}
+
+#define pthread_key_create CreateKey
+
+#include "dprint_coalescing.h"
+
+static void Sleep(double seconds) {
+  usleep((useconds_t)(seconds * 1e6));
+}
+
+static int Expect(const char* name, long lines, long summaries, long repeats) {
+  long actualLines, actualSummaries, actualRepeats;
+  ReadLog(&actualLines, &actualSummaries, &actualRepeats);
+  if (actualLines != lines || actualSummaries != summaries || actualRepeats != repeats) {
+    printf("FAIL %s: %ld lines, %ld summaries of %ld repeats; expected %ld, %ld and %ld\n", name,
+           actualLines, actualSummaries, actualRepeats, lines, summaries, repeats);
+    return 1;
+  }
+  return 0;
+}
+
+#pragma mark Tests
+
+// Runs in a child process so that the key creation fails on the first and only attempt.
+static int TestKeyCreationFailure(void) {
+  fflush(stdout);
+  pid_t child = fork();
+  if (child == 0) {
+    gShouldFailKeyCreation = 1;
+    for (int i = 0; i < 3; ++i) {
+      NIDPrintCoalesced("KeyFailure", 1, "not coalesced");
+    }
+    _exit(Expect("key creation failure", 3, 0, 0));
+  }
+  int status = 0;
+  waitpid(child, &status, 0);
+  return !WIFEXITED(status) || WEXITSTATUS(status) != 0;
+}
+
+// The summary must be written even though the thread never logs again.
+static int TestBurstThenSilence(void) {
+  ResetLog();
+  for (int i = 0; i < 100; ++i) {
+    NIDPrintCoalesced("Burst", 1, "burst");
+  }
+  int failures = Expect("burst", 1, 0, 0);
+  Sleep(NI_DPRINT_COALESCING_WINDOW * 4);
+  return failures + Expect("burst then silence", 1, 1, 99);
+}
+
+// A line that starts repeating while a flush is pending for another line is flushed by the
+// re-armed timer.
+static int TestRearm(void) {
+  ResetLog();
+  NIDPrintCoalesced("Rearm", 1, "first");
+  NIDPrintCoalesced("Rearm", 1, "first");
+  Sleep(NI_DPRINT_COALESCING_WINDOW * 0.6);
+  for (int i = 0; i < 5; ++i) {
+    NIDPrintCoalesced("Rearm", 2, "second");
+  }
+  Sleep(NI_DPRINT_COALESCING_WINDOW * 4);
+  return Expect("rearm", 2, 2, 5);
+}
+
+static void* LogAndExit(void* context) {
+  (void)context;
+  for (int i = 0; i < 10; ++i) {
+    NIDPrintCoalesced("LogAndExit", 1, "exiting");
+  }
+  return NULL;
+}
+
+// An exiting thread flushes its lines right away, and its table is reused by later threads.
+static int TestThreadExit(void) {
+  ResetLog();
+  int failures = 0;
+  for (int round = 0; round < 10; ++round) {
+    pthread_t threads[4];
+    for (int i = 0; i < 4; ++i) {
+      pthread_create(&threads[i], NULL, LogAndExit, NULL);
+    }
+    for (int i = 0; i < 4; ++i) {
+      pthread_join(threads[i], NULL);
+    }
+  }
+  failures += Expect("thread exit", 40, 40, 360);
+
+  int tableCount = 0;
+  NIDPrintCoalescingTable* table = __atomic_load_n(&NIDPrintCoalescingSharedState.tables, __ATOMIC_ACQUIRE);
+  for (; table; table = table->next) {
+    ++tableCount;
+  }
+  if (tableCount > 5) {
+    printf("FAIL thread exit: %d tables for at most 5 threads at once\n", tableCount);
+    ++failures;
+  }
+  return failures;
+}
+
+static int gIsLogging;
+static long gCallCount;
+
+static void* LogUntilStopped(void* context) {
+  long index = (long)context;
+  char message[32];
+  while (__atomic_load_n(&gIsLogging, __ATOMIC_RELAXED)) {
+    for (int i = 0; i < 50; ++i) {
+      snprintf(message, sizeof(message), "line %d", i % (int)(index + 2));
+      NIDPrintCoalesced("LogUntilStopped", i % 3, message);
+      __atomic_fetch_add(&gCallCount, 1, __ATOMIC_RELAXED);
+    }
+    usleep(100);
+  }
+  return NULL;
+}
+
+// Flushing every table at exit while threads log, flush on timers and exit must neither lose nor
+// double count a line.
+static int TestConcurrentExitFlush(void) {
+  ResetLog();
+  for (int round = 0; round < 3; ++round) {
+    __atomic_store_n(&gIsLogging, 1, __ATOMIC_RELAXED);
+    pthread_t threads[8];
+    for (long i = 0; i < 8; ++i) {
+      pthread_create(&threads[i], NULL, LogUntilStopped, (void *)i);
+    }
+    for (int i = 0; i < 100; ++i) {
+      NIDPrintCoalescingFlushAllTables();
+      usleep(1000);
+    }
+    __atomic_store_n(&gIsLogging, 0, __ATOMIC_RELAXED);
+    for (int i = 0; i < 8; ++i) {
+      pthread_join(threads[i], NULL);
+    }
+  }
+  Sleep(NI_DPRINT_COALESCING_WINDOW * 4);
+  NIDPrintCoalescingFlushAllTables();
+
+  long lines, summaries, repeats;
+  ReadLog(&lines, &summaries, &repeats);
+  long calls = __atomic_load_n(&gCallCount, __ATOMIC_RELAXED);
+  if (lines + repeats != calls) {
+    printf("FAIL concurrent exit flush: %ld lines and %ld repeats for %ld calls\n", lines, repeats,
+           calls);
+    return 1;
+  }
+  printf("%ld calls logged as %ld lines and %ld summaries\n", calls, lines, summaries);
+  return 0;
+}
+
+int main(void) {
+  int failures = 0;
+  failures += TestKeyCreationFailure();
+  failures += TestBurstThenSilence();
+  failures += TestRearm();
+  failures += TestThreadExit();
+  failures += TestConcurrentExitFlush();
+  if (__atomic_load_n(&gFlushesScheduled, __ATOMIC_RELAXED) == 0) {
+    printf("FAIL no flush was ever scheduled\n");
+    ++failures;
+  }
+
+  printf("%s\n", failures ? "FAILED" : "PASSED");
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,152 @@
+/*
+ Copyright 2014-present Jeff Verkoeyen. All Rights Reserved.
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+// Round-trips palettes through NIPaletteWriteFile and switches themes while other threads look up.
+
+#define NI_ENABLE_PALETTE_WRITER
+
+#include <pthread.h>
+#include <stdio.h>
+
+#include "NimbusKitBasics.h"
+
+#define kColorCount 1000
+#define kReaderCount 4
+#define kSwitchCount 200
+
+static char gNames[kColorCount][16];
+static const char* gNamePointers[kColorCount];
+static uint32_t gLightColors[kColorCount];
+static uint32_t gDarkColors[kColorCount];
+
+static NIPalette gPalette;
+static int gIsSwitching = 1;
+
+static int TestRoundTrip(const char* path) {
+  int failures = 0;
+  NIPalette palette = { 0 };
+  if (!NIPaletteOpen(&palette, path)) {
+    printf("couldn't open %s\n", path);
+    return 1;
+  }
+  for (int i = 0; i < kColorCount; ++i) {
+    uint32_t color = 0;
+    if (!NIPaletteLookup(&palette, gNames[i], &color) || color != gLightColors[i]) {
+      printf("%s: wrong color for %s\n", path, gNames[i]);
+      ++failures;
+    }
+  }
+  uint32_t color = 0;
+  if (NIPaletteLookup(&palette, "missing", &color)) {
+    printf("%s: found a missing name\n", path);
+    ++failures;
+  }
+  NIPaletteClose(&palette);
+  if (NIPaletteLookup(&palette, gNames[0], &color)) {
+    printf("%s: found a name after closing\n", path);
+    ++failures;
+  }
+  return failures;
+}
+
+static int TestRejectsDuplicates(const char* path) {
+  const char* names[] = { "tint", "tint" };
+  uint32_t colors[] = { 0xFF000000, 0xFFFFFFFF };
+  if (NIPaletteWriteFile(path, names, colors, 2)) {
+    printf("wrote a palette with duplicate names\n");
+    return 1;
+  }
+  return 0;
+}
+
+// Each lookup must return a color from one of the two themes, never garbage or a crash.
+static void* LookUpWhileSwitching(void* context) {
+  long failures = 0;
+  (void)context;
+  while (__atomic_load_n(&gIsSwitching, __ATOMIC_RELAXED)) {
+    for (int i = 0; i < kColorCount; ++i) {
+      uint32_t color = 0;
+      if (!NIPaletteLookup(&gPalette, gNames[i], &color)
+          || (color != gLightColors[i] && color != gDarkColors[i])) {
+        ++failures;
+      }
+    }
+  }
+  return (void *)failures;
+}
+
+static int TestSwitchingThemes(const char* lightPath, const char* darkPath) {
+  if (!NIPaletteOpen(&gPalette, lightPath)) {
+    printf("couldn't open %s\n", lightPath);
+    return 1;
+  }
+  pthread_t readers[kReaderCount];
+  for (int i = 0; i < kReaderCount; ++i) {
+    pthread_create(&readers[i], NULL, LookUpWhileSwitching, NULL);
+  }
+  int failures = 0;
+  for (int i = 0; i < kSwitchCount; ++i) {
+    failures += !NIPaletteOpen(&gPalette, (i & 1) ? lightPath : darkPath);
+  }
+  __atomic_store_n(&gIsSwitching, 0, __ATOMIC_RELAXED);
+  for (int i = 0; i < kReaderCount; ++i) {
+    void* readerFailures = NULL;
+    pthread_join(readers[i], &readerFailures);
+    failures += (int)(long)readerFailures;
+  }
+  if (failures) {
+    printf("%d failures while switching themes\n", failures);
+  }
+
+  // Switching back and forth must not map the files again.
+  int mappingCount = 0;
+  for (NIPaletteMapping* mapping = gPalette.mappings; mapping; mapping = mapping->next) {
+    ++mappingCount;
+  }
+  if (mappingCount != 2) {
+    printf("%d mappings after switching between 2 themes\n", mappingCount);
+    ++failures;
+  }
+  NIPaletteClose(&gPalette);
+  return failures;
+}
+
+int main(void) {
+  for (int i = 0; i < kColorCount; ++i) {
+    snprintf(gNames[i], sizeof(gNames[i]), "color%d", i);
+    gNamePointers[i] = gNames[i];
+    gLightColors[i] = 0xFF000000u | (uint32_t)i;
+    gDarkColors[i] = 0x80000000u | (uint32_t)i;
+  }
+
+  const char* lightPath = "palette_test_light.palette";
+  const char* darkPath = "palette_test_dark.palette";
+  int failures = 0;
+  if (!NIPaletteWriteFile(lightPath, gNamePointers, gLightColors, kColorCount)
+      || !NIPaletteWriteFile(darkPath, gNamePointers, gDarkColors, kColorCount)) {
+    printf("couldn't write the palettes\n");
+    return 1;
+  }
+  failures += TestRoundTrip(lightPath);
+  failures += TestRejectsDuplicates("palette_test_duplicates.palette");
+  failures += TestSwitchingThemes(lightPath, darkPath);
+  remove(lightPath);
+  remove(darkPath);
+  remove("palette_test_duplicates.palette");
+
+  printf("%s\n", failures ? "FAILED" : "PASSED");
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,173 @@
+/*
+ Copyright 2014-present Jeff Verkoeyen. All Rights Reserved.
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+// Checks the pixel snapping functions against snapping each value with floor, ceil and round.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "NimbusKitBasics.h"
+
+#define kValueCount 100000
+
+static CGFloat Snap(CGFloat value, CGFloat scale, NIPixelSnapMode mode) {
+  switch (mode) {
+    case NIPixelSnapModeFloor:
+    case NIPixelSnapModeOutset:
+      return floor(value * scale) / scale;
+    case NIPixelSnapModeCeil:
+      return ceil(value * scale) / scale;
+    case NIPixelSnapModeRound:
+      return round(value * scale) / scale;
+  }
+  return value;
+}
+
+static BOOL IsSame(CGFloat a, CGFloat b) {
+  return memcmp(&a, &b, sizeof(CGFloat)) == 0 || (isnan(a) && isnan(b));
+}
+
+// Values on and around the half-pixel ties, plus random values and the special values.
+static void FillValues(CGFloat* values, NSUInteger count) {
+  static const CGFloat special[] = {
+    0, -0.0, 0.5, -0.5, 1.5, -2.5, 0.49999999999999994, INFINITY, -INFINITY, NAN, 1e30, -1e30,
+  };
+  NSUInteger specialCount = sizeof(special) / sizeof(*special);
+  srand(1);
+  for (NSUInteger i = 0; i < count; ++i) {
+    if (i < specialCount) {
+      values[i] = special[i];
+    } else if (i & 1) {
+      values[i] = (CGFloat)(rand() % 20000 - 10000) / 6;
+    } else {
+      values[i] = (CGFloat)(rand() - RAND_MAX / 2) / (CGFloat)(rand() % 1000 + 1);
+    }
+  }
+}
+
+static int TestValues(CGFloat scale, NIPixelSnapMode mode) {
+  static CGFloat values[kValueCount];
+  static CGFloat snapped[kValueCount];
+  FillValues(values, kValueCount);
+  memcpy(snapped, values, sizeof(values));
+  NISnapValuesToPixels(snapped, kValueCount, scale, mode);
+
+  int failures = 0;
+  for (NSUInteger i = 0; i < kValueCount; ++i) {
+    CGFloat expected = Snap(values[i], scale, mode);
+    if (!IsSame(snapped[i], expected)) {
+      if (failures++ < 5) {
+        printf("mode %d scale %g: %.17g snapped to %.17g, expected %.17g\n",
+               (int)mode, (double)scale, (double)values[i], (double)snapped[i], (double)expected);
+      }
+    }
+  }
+  return failures;
+}
+
+static int TestRects(CGFloat scale, NIPixelSnapMode mode) {
+  enum { kRectCount = kValueCount / 4 };
+  static CGFloat values[kValueCount];
+  static CGRect rects[kRectCount];
+  FillValues(values, kValueCount);
+  for (NSUInteger i = 0; i < kRectCount; ++i) {
+    rects[i].origin.x = values[i * 4];
+    rects[i].origin.y = values[i * 4 + 1];
+    rects[i].size.width = fabs(values[i * 4 + 2]);
+    rects[i].size.height = fabs(values[i * 4 + 3]);
+  }
+  CGRect* snapped = (CGRect *)malloc(sizeof(rects));
+  memcpy(snapped, rects, sizeof(rects));
+  NISnapRectsToPixels(snapped, kRectCount, scale, mode);
+
+  int failures = 0;
+  NIPixelSnapMode maxMode = mode == NIPixelSnapModeOutset ? NIPixelSnapModeCeil : mode;
+  for (NSUInteger i = 0; i < kRectCount; ++i) {
+    CGFloat minX = Snap(rects[i].origin.x, scale, mode);
+    CGFloat minY = Snap(rects[i].origin.y, scale, mode);
+    CGFloat maxX = Snap(rects[i].origin.x + rects[i].size.width, scale, maxMode);
+    CGFloat maxY = Snap(rects[i].origin.y + rects[i].size.height, scale, maxMode);
+    if (!IsSame(snapped[i].origin.x, minX) || !IsSame(snapped[i].origin.y, minY)
+        || !IsSame(snapped[i].size.width, maxX - minX)
+        || !IsSame(snapped[i].size.height, maxY - minY)) {
+      if (failures++ < 5) {
+        printf("mode %d scale %g: rect %lu snapped incorrectly\n",
+               (int)mode, (double)scale, (unsigned long)i);
+      }
+    }
+  }
+  free(snapped);
+  return failures;
+}
+
+// Points floor and sizes ceil in NIPixelSnapModeOutset; otherwise both snap like values.
+static int TestPointsAndSizes(CGFloat scale, NIPixelSnapMode mode) {
+  enum { kPairCount = kValueCount / 2 };
+  static CGFloat values[kValueCount];
+  static CGPoint points[kPairCount];
+  static CGSize sizes[kPairCount];
+  FillValues(values, kValueCount);
+  for (NSUInteger i = 0; i < kPairCount; ++i) {
+    points[i].x = values[i * 2];
+    points[i].y = values[i * 2 + 1];
+    sizes[i].width = values[i * 2];
+    sizes[i].height = values[i * 2 + 1];
+  }
+  NISnapPointsToPixels(points, kPairCount, scale, mode);
+  NISnapSizesToPixels(sizes, kPairCount, scale, mode);
+
+  int failures = 0;
+  NIPixelSnapMode pointMode = mode == NIPixelSnapModeOutset ? NIPixelSnapModeFloor : mode;
+  NIPixelSnapMode sizeMode = mode == NIPixelSnapModeOutset ? NIPixelSnapModeCeil : mode;
+  for (NSUInteger i = 0; i < kPairCount; ++i) {
+    if (!IsSame(points[i].x, Snap(values[i * 2], scale, pointMode))
+        || !IsSame(points[i].y, Snap(values[i * 2 + 1], scale, pointMode))) {
+      if (failures++ < 5) {
+        printf("mode %d scale %g: point %lu snapped incorrectly\n",
+               (int)mode, (double)scale, (unsigned long)i);
+      }
+    }
+    if (!IsSame(sizes[i].width, Snap(values[i * 2], scale, sizeMode))
+        || !IsSame(sizes[i].height, Snap(values[i * 2 + 1], scale, sizeMode))) {
+      if (failures++ < 5) {
+        printf("mode %d scale %g: size %lu snapped incorrectly\n",
+               (int)mode, (double)scale, (unsigned long)i);
+      }
+    }
+  }
+  return failures;
+}
+
+int main(void) {
+  static const CGFloat scales[] = { 1, 2, 3 };
+  static const NIPixelSnapMode modes[] = {
+    NIPixelSnapModeFloor, NIPixelSnapModeCeil, NIPixelSnapModeRound, NIPixelSnapModeOutset,
+  };
+
+  printf("CGFloat is %s\n", CGFLOAT_IS_DOUBLE ? "double" : "float");
+  int failures = 0;
+  for (NSUInteger i = 0; i < sizeof(scales) / sizeof(*scales); ++i) {
+    for (NSUInteger j = 0; j < sizeof(modes) / sizeof(*modes); ++j) {
+      failures += TestValues(scales[i], modes[j]);
+      failures += TestRects(scales[i], modes[j]);
+      failures += TestPointsAndSizes(scales[i], modes[j]);
+    }
+  }
+
+  printf("%s\n", failures ? "FAILED" : "PASSED");
+  return failures ? 1 : 0;
+}
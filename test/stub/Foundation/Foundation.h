@@ -0,0 +1,59 @@
+/*
+ Copyright 2014-present Jeff Verkoeyen. All Rights Reserved.
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+// The handful of Foundation and Core Graphics definitions that NimbusKitBasics.h needs, so that
+// its C functions can be tested and benchmarked with a plain C compiler on Linux.
+
+#ifndef _NIMBUSKIT_BASICS_TEST_FOUNDATION_H_
+#define _NIMBUSKIT_BASICS_TEST_FOUNDATION_H_
+
+#include <float.h>
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define TARGET_OS_IPHONE 0
+
+#ifndef __has_feature
+#define __has_feature(x) 0
+#endif
+
+typedef unsigned long NSUInteger;
+typedef long NSInteger;
+typedef signed char BOOL;
+#define YES ((BOOL)1)
+#define NO  ((BOOL)0)
+
+#define NSNotFound ((NSInteger)(~0UL >> 1))
+
+#define NS_ENUM(_type, _name) _type _name; enum
+#define NS_OPTIONS(_type, _name) _type _name; enum
+
+#ifndef CGFLOAT_IS_DOUBLE
+#define CGFLOAT_IS_DOUBLE 1
+#endif
+
+#if CGFLOAT_IS_DOUBLE
+typedef double CGFloat;
+#else
+typedef float CGFloat;
+#endif
+
+typedef struct { CGFloat x, y; } CGPoint;
+typedef struct { CGFloat width, height; } CGSize;
+typedef struct { CGPoint origin; CGSize size; } CGRect;
+
+#endif // #ifndef _NIMBUSKIT_BASICS_TEST_FOUNDATION_H_
@@ -0,0 +1,79 @@
+/*
+ Copyright 2014-present Jeff Verkoeyen. All Rights Reserved.
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+// Compares table lookups, one at a time and batched, against solving each curve directly.
+
+#include <stdio.h>
+#include <time.h>
+
+#include "NimbusKitBasics.h"
+
+enum { kCurveCount = 64, kPairCount = 1 << 20, kRepetitions = 20 };
+
+static double Now(void) {
+  struct timespec time;
+  clock_gettime(CLOCK_MONOTONIC, &time);
+  return (double)time.tv_sec + (double)time.tv_nsec * 1e-9;
+}
+
+int main(void) {
+  static NITimingCurve curves[kCurveCount];
+  static uint32_t curveIndexes[kPairCount];
+  static CGFloat times[kPairCount];
+  static CGFloat values[kPairCount];
+
+  for (uint32_t i = 0; i < kCurveCount; ++i) {
+    CGFloat x1 = (CGFloat)(i % 8) / 8;
+    CGFloat x2 = (CGFloat)(i / 8) / 8;
+    NITimingCurveInit(&curves[i], x1, (CGFloat)0.1, x2, (CGFloat)0.9);
+  }
+  for (uint32_t i = 0; i < kPairCount; ++i) {
+    curveIndexes[i] = (i * 2654435761u) % kCurveCount;
+    times[i] = (CGFloat)((i * 7919u) % kPairCount) / kPairCount;
+  }
+
+  CGFloat checksum = 0;
+  double start = Now();
+  for (int repetition = 0; repetition < kRepetitions; ++repetition) {
+    NITimingCurveEvaluateBatch(curves, curveIndexes, times, values, kPairCount);
+    checksum += values[repetition];
+  }
+  double batchTime = (Now() - start) / ((double)kRepetitions * kPairCount);
+
+  start = Now();
+  for (int repetition = 0; repetition < kRepetitions; ++repetition) {
+    for (uint32_t i = 0; i < kPairCount; ++i) {
+      values[i] = NITimingCurveEvaluate(&curves[curveIndexes[i]], times[i]);
+    }
+    checksum += values[repetition];
+  }
+  double evaluateTime = (Now() - start) / ((double)kRepetitions * kPairCount);
+
+  start = Now();
+  for (uint32_t i = 0; i < kPairCount; ++i) {
+    values[i] = NITimingCurveSolve(&curves[curveIndexes[i]], times[i]);
+  }
+  checksum += values[0];
+  double solveTime = (Now() - start) / kPairCount;
+
+  printf("%d curves, %d (curve, time) pairs, CGFloat is %s\n", kCurveCount, kPairCount,
+         CGFLOAT_IS_DOUBLE ? "double" : "float");
+  printf("NITimingCurveEvaluateBatch  %6.2f ns/pair\n", batchTime * 1e9);
+  printf("NITimingCurveEvaluate       %6.2f ns/pair\n", evaluateTime * 1e9);
+  printf("NITimingCurveSolve          %6.2f ns/pair\n", solveTime * 1e9);
+  printf("(checksum %g)\n", (double)checksum);
+  return 0;
+}
@@ -0,0 +1,146 @@
+/*
+ Copyright 2014-present Jeff Verkoeyen. All Rights Reserved.
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+// Checks NITimingCurveSolve and NITimingCurveEvaluate against a long double reference solve.
+
+#include <stdio.h>
+
+#include "NimbusKitBasics.h"
+
+#define kSampleCount 100000
+
+typedef struct {
+  const char* name;
+  double x1, y1, x2, y2;
+  BOOL hasVerticalTangent;
+  double tableTolerance; // 0 skips the table check.
+} TestCurve;
+
+// The solve and table tolerances are the bounds promised by the documentation of
+// NITimingCurveSolve and NITimingCurveEvaluate.
+static const TestCurve kCurves[] = {
+  { "linear",           0,    0,     1,     1,    NO,  1e-4 },
+  { "ease",             0.25, 0.1,   0.25,  1,    NO,  1e-4 },
+  { "ease-in",          0.42, 0,     1,     1,    NO,  1e-4 },
+  { "ease-out",         0,    0,     0.58,  1,    NO,  1e-4 },
+  { "ease-in-out",      0.42, 0,     0.58,  1,    NO,  1e-4 },
+  { "back",             0.68, -0.55, 0.265, 1.55, NO,  1e-3 },
+  { "steep",            0.9,  0,     0.1,   1,    NO,  1e-3 },
+  { "vertical tangent", 0,    1,     1,     0,    YES, 0 },
+};
+
+// Bisects for the parameter in long double precision, well beyond that of CGFloat.
+static long double ReferenceValue(const TestCurve* curve, long double x) {
+  long double lower = 0;
+  long double upper = 1;
+  long double t = 0.5L;
+  for (int i = 0; i < 200; ++i) {
+    t = (lower + upper) / 2;
+    long double u = 1 - t;
+    long double curveX = 3 * u * u * t * curve->x1 + 3 * u * t * t * curve->x2 + t * t * t;
+    if (curveX < x) {
+      lower = t;
+    } else {
+      upper = t;
+    }
+  }
+  long double u = 1 - t;
+  return 3 * u * u * t * curve->y1 + 3 * u * t * t * curve->y2 + t * t * t;
+}
+
+static int TestAccuracy(const TestCurve* testCurve, const NITimingCurve* curve) {
+  double maxSolveError = 0;
+  double maxTableError = 0;
+  for (int i = 0; i <= kSampleCount; ++i) {
+    long double x = (long double)i / kSampleCount;
+    long double expected = ReferenceValue(testCurve, x);
+    double solveError = (double)fabsl(NITimingCurveSolve(curve, (CGFloat)x) - expected);
+    double tableError = (double)fabsl(NITimingCurveEvaluate(curve, (CGFloat)x) - expected);
+    maxSolveError = solveError > maxSolveError ? solveError : maxSolveError;
+    maxTableError = tableError > maxTableError ? tableError : maxTableError;
+  }
+
+  int failures = 0;
+  double solveTolerance = testCurve->hasVerticalTangent ? sqrt(NI_CGFLOAT_EPSILON)
+                                                        : 64 * NI_CGFLOAT_EPSILON;
+  if (maxSolveError > solveTolerance) {
+    printf("FAIL %s: solve error %g exceeds %g\n", testCurve->name, maxSolveError, solveTolerance);
+    ++failures;
+  }
+  if (testCurve->tableTolerance > 0 && maxTableError > testCurve->tableTolerance) {
+    printf("FAIL %s: table error %g exceeds %g\n", testCurve->name, maxTableError, testCurve->tableTolerance);
+    ++failures;
+  }
+  printf("%-16s solve error %.3g, table error %.3g\n", testCurve->name, maxSolveError, maxTableError);
+  return failures;
+}
+
+static int TestClamping(const NITimingCurve* curve) {
+  int failures = 0;
+  CGFloat outOfRange[] = { -1, -0.0, 2, INFINITY, -INFINITY };
+  CGFloat expected[] = { 0, 0, 1, 1, 0 };
+  for (size_t i = 0; i < sizeof(outOfRange) / sizeof(*outOfRange); ++i) {
+    CGFloat value = NITimingCurveEvaluate(curve, outOfRange[i]);
+    if (value != expected[i]) {
+      printf("FAIL clamping: %g evaluated to %g, expected %g\n", (double)outOfRange[i], (double)value,
+             (double)expected[i]);
+      ++failures;
+    }
+  }
+  CGFloat value = NITimingCurveEvaluate(curve, NAN);
+  if (value != 0 && value != 1) {
+    printf("FAIL clamping: NaN evaluated to %g\n", (double)value);
+    ++failures;
+  }
+  return failures;
+}
+
+static int TestBatchMatchesEvaluate(const NITimingCurve* curves, uint32_t curveCount) {
+  enum { kBatchCount = 1000 };
+  static uint32_t curveIndexes[kBatchCount];
+  static CGFloat times[kBatchCount];
+  static CGFloat values[kBatchCount];
+  for (uint32_t i = 0; i < kBatchCount; ++i) {
+    curveIndexes[i] = (i * 7) % curveCount;
+    times[i] = (CGFloat)((i * 37) % 1201) / 1000 - (CGFloat)0.1;
+  }
+  NITimingCurveEvaluateBatch(curves, curveIndexes, times, values, kBatchCount);
+  for (uint32_t i = 0; i < kBatchCount; ++i) {
+    CGFloat expected = NITimingCurveEvaluate(&curves[curveIndexes[i]], times[i]);
+    if (values[i] != expected) {
+      printf("FAIL batch: pair %u evaluated to %g, expected %g\n", i, (double)values[i], (double)expected);
+      return 1;
+    }
+  }
+  return 0;
+}
+
+int main(void) {
+  enum { kCurveCount = sizeof(kCurves) / sizeof(*kCurves) };
+  static NITimingCurve curves[kCurveCount];
+
+  printf("CGFloat is %s\n", CGFLOAT_IS_DOUBLE ? "double" : "float");
+  int failures = 0;
+  for (uint32_t i = 0; i < kCurveCount; ++i) {
+    NITimingCurveInit(&curves[i], kCurves[i].x1, kCurves[i].y1, kCurves[i].x2, kCurves[i].y2);
+    failures += TestAccuracy(&kCurves[i], &curves[i]);
+  }
+  failures += TestClamping(&curves[1]);
+  failures += TestBatchMatchesEvaluate(curves, kCurveCount);
+
+  printf("%s\n", failures ? "FAILED" : "PASSED");
+  return failures ? 1 : 0;
+}